@@ -1,15 +1,32 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec2 aTexCoords;
+// same locations as the model vertex layout, the town is drawn with this shader too
+layout (location = 2) in vec2 aTexCoords;
 
 out vec2 TexCoords;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+
+// set while a model is drawn instanced, the model matrix then comes from the instance attributes
+uniform bool instanced;
+layout (location = 5) in mat4 aInstanceModel;
+
+// packed meshes store snorm16 positions relative to their bounds
+uniform bool packedVertex;
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
+layout (std140) uniform Camera
+{
+	mat4 view;
+	mat4 projection;
+	vec4 viewPos;
+};
 
 void main()
 {
+	mat4 world = instanced ? aInstanceModel : model;
+	vec3 position = packedVertex ? positionOffset + aPos * positionScale : aPos;
 	TexCoords = aTexCoords;
-	gl_Position = projection * view * model * vec4(aPos, 1.0);
+	gl_Position = projection * view * world * vec4(position, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,708 @@
+#include "BakedTexture.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+#include "stb_image.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BAKE_SSE
+#endif
+
+static const char BAKED_TEXTURE_MAGIC[4] = { 'B', 'T', 'E', 'X' };
+
+// FNV-1a, stable across runs and platforms
+static uint64_t hashString(const std::string &value)
+{
+	uint64_t hash = 14695981039346656037ull;
+	for (unsigned char c : value)
+	{
+		hash ^= c;
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+static uint64_t sourceModifiedTime(const std::string &path)
+{
+#ifdef _WIN32
+	struct _stat64 fileStat;
+	if (_stat64(path.c_str(), &fileStat) != 0)
+	{
+		return 0;
+	}
+#else
+	struct stat fileStat;
+	if (stat(path.c_str(), &fileStat) != 0)
+	{
+		return 0;
+	}
+#endif
+	return (uint64_t)fileStat.st_mtime;
+}
+
+static uint64_t alignOffset(uint64_t offset, uint64_t alignment)
+{
+	return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+static void writePadding(std::ofstream &out, uint64_t from, uint64_t to)
+{
+	static const char zeros[16] = {};
+	out.write(zeros, (std::streamsize)(to - from));
+}
+
+static std::string lowerCase(std::string value)
+{
+	std::transform(value.begin(), value.end(), value.begin(), [](char c) { return (char)std::tolower((unsigned char)c); });
+	return value;
+}
+
+static bool isImageFile(const std::string &path)
+{
+	size_t dot = path.find_last_of('.');
+	if (dot == std::string::npos)
+	{
+		return false;
+	}
+	std::string extension = lowerCase(path.substr(dot + 1));
+	return extension == "png" || extension == "jpg" || extension == "jpeg" || extension == "tga" || extension == "bmp";
+}
+
+// whether one of the _ - . separated words of the file name is in tokens
+static bool hasNameToken(const std::string &path, const char *const *tokens, size_t tokenCount)
+{
+	size_t slash = path.find_last_of("/\\");
+	std::string name = lowerCase(slash == std::string::npos ? path : path.substr(slash + 1));
+	size_t start = 0;
+	while (start < name.size())
+	{
+		size_t end = name.find_first_of("_-. ", start);
+		if (end == std::string::npos)
+		{
+			end = name.size();
+		}
+		std::string token = name.substr(start, end - start);
+		for (size_t i = 0; i < tokenCount; i++)
+		{
+			if (token == tokens[i])
+			{
+				return true;
+			}
+		}
+		start = end + 1;
+	}
+	return false;
+}
+
+static void listFiles(const std::string &directory, std::vector<std::string> &files)
+{
+#ifdef _WIN32
+	WIN32_FIND_DATAA found;
+	HANDLE search = FindFirstFileA((directory + "/*").c_str(), &found);
+	if (search == INVALID_HANDLE_VALUE)
+	{
+		return;
+	}
+	do
+	{
+		std::string name = found.cFileName;
+		if (name == "." || name == "..")
+		{
+			continue;
+		}
+		if (found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+		{
+			listFiles(directory + "/" + name, files);
+		}
+		else
+		{
+			files.push_back(directory + "/" + name);
+		}
+	} while (FindNextFileA(search, &found));
+	FindClose(search);
+#else
+	DIR *dir = opendir(directory.c_str());
+	if (!dir)
+	{
+		return;
+	}
+	while (dirent *entry = readdir(dir))
+	{
+		std::string name = entry->d_name;
+		if (name == "." || name == "..")
+		{
+			continue;
+		}
+		std::string path = directory + "/" + name;
+		struct stat fileStat;
+		if (stat(path.c_str(), &fileStat) != 0)
+		{
+			continue;
+		}
+		if (S_ISDIR(fileStat.st_mode))
+		{
+			listFiles(path, files);
+		}
+		else
+		{
+			files.push_back(path);
+		}
+	}
+	closedir(dir);
+#endif
+}
+
+/* Mip filtering */
+// levels are filtered as four floats per pixel, linear light for color textures
+
+struct FloatImage {
+	int width;
+	int height;
+	std::vector<float> pixels;
+};
+
+static float srgbToLinear(float value)
+{
+	return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+}
+
+static float linearToSrgb(float value)
+{
+	return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+}
+
+static FloatImage toFloat(const unsigned char *pixels, int width, int height, int components, bool srgb)
+{
+	float decode[256];
+	for (int i = 0; i < 256; i++)
+	{
+		decode[i] = srgb ? srgbToLinear(i / 255.0f) : i / 255.0f;
+	}
+
+	FloatImage image;
+	image.width = width;
+	image.height = height;
+	image.pixels.resize((size_t)width * height * 4);
+	for (size_t i = 0; i < (size_t)width * height; i++)
+	{
+		const unsigned char *source = pixels + i * components;
+		float *target = &image.pixels[i * 4];
+		for (int c = 0; c < 4; c++)
+		{
+			if (c < components)
+			{
+				// alpha is always linear
+				target[c] = (c == 3 || (c == 1 && components == 2)) ? source[c] / 255.0f : decode[source[c]];
+			}
+			else
+			{
+				target[c] = c == 3 ? 1.0f : 0.0f;
+			}
+		}
+	}
+	return image;
+}
+
+static void fromFloat(const FloatImage &image, int components, bool srgb, unsigned char *pixels)
+{
+	for (size_t i = 0; i < (size_t)image.width * image.height; i++)
+	{
+		const float *source = &image.pixels[i * 4];
+		unsigned char *target = pixels + i * components;
+		for (int c = 0; c < components; c++)
+		{
+			// the Kaiser filter's negative lobes can overshoot
+			float value = std::min(std::max(source[c], 0.0f), 1.0f);
+			bool alpha = c == 3 || (c == 1 && components == 2);
+			if (srgb && !alpha)
+			{
+				value = linearToSrgb(value);
+			}
+			target[c] = (unsigned char)(value * 255.0f + 0.5f);
+		}
+	}
+}
+
+static double besselI0(double x)
+{
+	// power series, converges quickly for the small arguments used here
+	double sum = 1.0;
+	double term = 1.0;
+	for (int k = 1; k < 32; k++)
+	{
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum += term;
+	}
+	return sum;
+}
+
+// weights for halving a dimension, tap k reads source pixel 2 * x + firstTap + k
+struct MipKernel {
+	int firstTap;
+	std::vector<float> weights;
+};
+
+static MipKernel mipKernel(MipFilter filter)
+{
+	MipKernel kernel;
+	if (filter == MIP_FILTER_BOX)
+	{
+		kernel.firstTap = 0;
+		kernel.weights = { 0.5f, 0.5f };
+		return kernel;
+	}
+
+	// sinc at half the source rate, windowed by a Kaiser window three source pixels wide on each side
+	const double alpha = 4.0;
+	const double halfWidth = 3.0;
+	const double pi = 3.14159265358979323846;
+	kernel.firstTap = -2;
+	double total = 0.0;
+	std::vector<double> weights;
+	for (int k = 0; k < 6; k++)
+	{
+		// distance from the destination pixel center, in source pixels
+		double distance = (k + kernel.firstTap + 0.5) - 1.0;
+		double x = pi * distance / 2.0;
+		double sinc = x == 0.0 ? 1.0 : std::sin(x) / x;
+		double t = distance / halfWidth;
+		double window = besselI0(alpha * std::sqrt(std::max(0.0, 1.0 - t * t))) / besselI0(alpha);
+		weights.push_back(sinc * window);
+		total += sinc * window;
+	}
+	for (double weight : weights)
+	{
+		kernel.weights.push_back((float)(weight / total));
+	}
+	return kernel;
+}
+
+// out = sum of weights[k] * in[index[k]], one pixel of four floats
+static inline void filterPixel(const float *const *sources, const float *weights, size_t taps, float *out)
+{
+#ifdef BAKE_SSE
+	__m128 sum = _mm_setzero_ps();
+	for (size_t k = 0; k < taps; k++)
+	{
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(sources[k]), _mm_set1_ps(weights[k])));
+	}
+	_mm_storeu_ps(out, sum);
+#else
+	float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	for (size_t k = 0; k < taps; k++)
+	{
+		for (int c = 0; c < 4; c++)
+		{
+			sum[c] += sources[k][c] * weights[k];
+		}
+	}
+	std::memcpy(out, sum, sizeof(sum));
+#endif
+}
+
+static int wrap(int value, int size)
+{
+	value %= size;
+	return value < 0 ? value + size : value;
+}
+
+// halves both dimensions (down to 1), wrapping around the edges like the GL_REPEAT sampler does
+static FloatImage downsample(const FloatImage &source, const MipKernel &kernel)
+{
+	size_t taps = kernel.weights.size();
+	std::vector<const float*> sources(taps);
+
+	// horizontal pass
+	FloatImage horizontal;
+	horizontal.width = std::max(1, source.width / 2);
+	horizontal.height = source.height;
+	horizontal.pixels.resize((size_t)horizontal.width * horizontal.height * 4);
+	for (int y = 0; y < source.height; y++)
+	{
+		const float *row = &source.pixels[(size_t)y * source.width * 4];
+		for (int x = 0; x < horizontal.width; x++)
+		{
+			for (size_t k = 0; k < taps; k++)
+			{
+				int sourceX = source.width > 1 ? wrap(2 * x + kernel.firstTap + (int)k, source.width) : 0;
+				sources[k] = row + sourceX * 4;
+			}
+			filterPixel(sources.data(), kernel.weights.data(), taps, &horizontal.pixels[((size_t)y * horizontal.width + x) * 4]);
+		}
+	}
+
+	// vertical pass
+	FloatImage result;
+	result.width = horizontal.width;
+	result.height = std::max(1, source.height / 2);
+	result.pixels.resize((size_t)result.width * result.height * 4);
+	for (int y = 0; y < result.height; y++)
+	{
+		for (int x = 0; x < result.width; x++)
+		{
+			for (size_t k = 0; k < taps; k++)
+			{
+				int sourceY = source.height > 1 ? wrap(2 * y + kernel.firstTap + (int)k, source.height) : 0;
+				sources[k] = &horizontal.pixels[((size_t)sourceY * horizontal.width + x) * 4];
+			}
+			filterPixel(sources.data(), kernel.weights.data(), taps, &result.pixels[((size_t)y * result.width + x) * 4]);
+		}
+	}
+	return result;
+}
+
+static bool bakeOnImport = false;
+static TextureBakeOptions importOptions;
+
+void BakedTexture::EnableBakeOnImport(const TextureBakeOptions &options)
+{
+	importOptions = options;
+	bakeOnImport = true;
+}
+
+bool BakedTexture::BakeOnImport(TextureBakeOptions &options)
+{
+	options = importOptions;
+	return bakeOnImport;
+}
+
+std::string BakedTexture::BakedPath(const std::string &sourcePath)
+{
+	return sourcePath + ".btex";
+}
+
+bool BakedTexture::IsColorTexture(const std::string &path)
+{
+	// normal, specular and similar maps are named after what they hold, e.g. arm_showroom_ddn.png
+	static const char *dataTokens[] = {
+		"ddn", "normal", "normals", "nrm", "norm", "bump", "height", "disp", "displacement",
+		"spec", "specular", "gloss", "rough", "roughness", "metallic", "ao", "occlusion", "mask"
+	};
+	return !hasNameToken(path, dataTokens, sizeof(dataTokens) / sizeof(dataTokens[0]));
+}
+
+bool BakedTexture::IsNormalMap(const std::string &path)
+{
+	static const char *normalTokens[] = { "ddn", "normal", "normals", "nrm", "norm" };
+	return hasNameToken(path, normalTokens, sizeof(normalTokens) / sizeof(normalTokens[0]));
+}
+
+static BlockFormat chooseBlockFormat(const std::string &path, const unsigned char *pixels, int width, int height,
+	int components, const TextureBakeOptions &options)
+{
+	if (!options.compress || components < 3)
+	{
+		return BLOCK_FORMAT_NONE;
+	}
+
+	BlockFormat format;
+	if (BakedTexture::IsNormalMap(path))
+	{
+		// X and Y only, Z is reconstructed from them
+		format = BLOCK_FORMAT_BC5;
+	}
+	else if (options.quality == COMPRESSION_HIGH)
+	{
+		format = BLOCK_FORMAT_BC7;
+	}
+	else
+	{
+		bool alpha = false;
+		for (size_t i = 0; components == 4 && !alpha && i < (size_t)width * height; i++)
+		{
+			alpha = pixels[i * 4 + 3] != 255;
+		}
+		format = alpha ? BLOCK_FORMAT_BC3 : BLOCK_FORMAT_BC1;
+	}
+
+	if (options.supportedFormatsOnly && !IsBlockFormatSupported(format))
+	{
+		return BLOCK_FORMAT_NONE;
+	}
+	return format;
+}
+
+// expands a level to four channels, what the block encoder reads
+static std::vector<unsigned char> toRGBA(const unsigned char *pixels, int width, int height, int components)
+{
+	std::vector<unsigned char> rgba((size_t)width * height * 4);
+	for (size_t i = 0; i < (size_t)width * height; i++)
+	{
+		for (int c = 0; c < 4; c++)
+		{
+			rgba[i * 4 + c] = c < components ? pixels[i * components + c] : (c == 3 ? 255 : 0);
+		}
+	}
+	return rgba;
+}
+
+bool BakedTexture::Bake(const std::string &sourcePath, const TextureBakeOptions &options)
+{
+	uint64_t modified = sourceModifiedTime(sourcePath);
+	if (modified == 0)
+	{
+		return false;
+	}
+
+	int width, height, components;
+	unsigned char *pixels = stbi_load(sourcePath.c_str(), &width, &height, &components, 0);
+	if (!pixels)
+	{
+		return false;
+	}
+	std::shared_ptr<unsigned char> source(pixels, stbi_image_free);
+
+	// one and two channel images are masks or data, only RGB(A) can be color
+	bool srgb = components >= 3 && IsColorTexture(sourcePath);
+
+	BakedTextureHeader bakedHeader = {};
+	std::memcpy(bakedHeader.magic, BAKED_TEXTURE_MAGIC, sizeof(BAKED_TEXTURE_MAGIC));
+	bakedHeader.version = BAKED_TEXTURE_VERSION;
+	bakedHeader.sourceModified = modified;
+	bakedHeader.sourcePathHash = hashString(TextureManager::CanonicalPath(sourcePath));
+	bakedHeader.contentHash = TextureImageHash(pixels, width, height, components);
+	bakedHeader.width = (uint32_t)width;
+	bakedHeader.height = (uint32_t)height;
+	bakedHeader.components = (uint32_t)components;
+	bakedHeader.flags = srgb ? BAKED_TEXTURE_SRGB : 0;
+	BlockFormat blockFormat = chooseBlockFormat(sourcePath, pixels, width, height, components, options);
+	bakedHeader.blockFormat = (uint32_t)blockFormat;
+
+	// level 0 is the source as is, every other level is filtered from the one above it
+	std::vector<std::vector<unsigned char>> levels;
+	std::vector<BakedTextureLevel> levelIndex;
+	levels.emplace_back(pixels, pixels + (size_t)width * height * components);
+	FloatImage level = toFloat(pixels, width, height, components, srgb);
+	MipKernel kernel = mipKernel(options.filter);
+	while (level.width > 1 || level.height > 1)
+	{
+		level = downsample(level, kernel);
+		levels.emplace_back((size_t)level.width * level.height * components);
+		fromFloat(level, components, srgb, levels.back().data());
+	}
+	bakedHeader.levelCount = (uint32_t)levels.size();
+
+	if (blockFormat != BLOCK_FORMAT_NONE)
+	{
+		int levelWidth = width;
+		int levelHeight = height;
+		for (size_t i = 0; i < levels.size(); i++)
+		{
+			std::vector<unsigned char> rgba = toRGBA(levels[i].data(), levelWidth, levelHeight, components);
+			std::vector<unsigned char> blocks(CompressedImageSize(blockFormat, levelWidth, levelHeight));
+			CompressImage(rgba.data(), levelWidth, levelHeight, blockFormat, options.quality, blocks.data());
+			if (i == 0)
+			{
+				// quality of the full size level, over the channels the format keeps
+				std::vector<unsigned char> decoded(rgba.size());
+				DecompressImage(blocks.data(), levelWidth, levelHeight, blockFormat, decoded.data());
+				int channels = blockFormat == BLOCK_FORMAT_BC5 ? 2 : blockFormat == BLOCK_FORMAT_BC1 ? 3 : components;
+				// one write, bakes run on several threads at once
+				std::ostringstream line;
+				line << "BAKED_TEXTURE::" << sourcePath << " " << BlockFormatName(blockFormat) << " PSNR "
+					<< ComputePSNR(rgba.data(), decoded.data(), levelWidth, levelHeight, channels) << " dB\n";
+				std::cout << line.str() << std::flush;
+			}
+			levels[i].swap(blocks);
+			levelWidth = std::max(1, levelWidth / 2);
+			levelHeight = std::max(1, levelHeight / 2);
+		}
+	}
+
+	uint64_t offset = sizeof(BakedTextureHeader) + levels.size() * sizeof(BakedTextureLevel);
+	int levelWidth = width;
+	int levelHeight = height;
+	for (const std::vector<unsigned char> &data : levels)
+	{
+		BakedTextureLevel entry;
+		offset = alignOffset(offset, 16);
+		entry.offset = offset;
+		entry.size = data.size();
+		entry.width = (uint32_t)levelWidth;
+		entry.height = (uint32_t)levelHeight;
+		levelIndex.push_back(entry);
+		offset += data.size();
+		levelWidth = std::max(1, levelWidth / 2);
+		levelHeight = std::max(1, levelHeight / 2);
+	}
+
+	// write to a temporary file so a crash never leaves a half written bake behind
+	std::string bakedPath = BakedPath(sourcePath);
+	std::string tempPath = bakedPath + ".tmp";
+	std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+	if (!out)
+	{
+		return false;
+	}
+
+	out.write(reinterpret_cast<const char*>(&bakedHeader), sizeof(bakedHeader));
+	out.write(reinterpret_cast<const char*>(levelIndex.data()), (std::streamsize)(levelIndex.size() * sizeof(BakedTextureLevel)));
+	uint64_t written = sizeof(BakedTextureHeader) + levelIndex.size() * sizeof(BakedTextureLevel);
+	for (size_t i = 0; i < levels.size(); i++)
+	{
+		writePadding(out, written, levelIndex[i].offset);
+		out.write(reinterpret_cast<const char*>(levels[i].data()), (std::streamsize)levels[i].size());
+		written = levelIndex[i].offset + levels[i].size();
+	}
+
+	out.close();
+	if (!out)
+	{
+		std::remove(tempPath.c_str());
+		return false;
+	}
+
+	std::remove(bakedPath.c_str());
+	if (std::rename(tempPath.c_str(), bakedPath.c_str()) != 0)
+	{
+		std::remove(tempPath.c_str());
+		return false;
+	}
+	return true;
+}
+
+unsigned int BakedTexture::BakeDirectories(const std::vector<std::string> &directories, const TextureBakeOptions &options)
+{
+	std::vector<std::string> files;
+	for (const std::string &directory : directories)
+	{
+		listFiles(directory, files);
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+	std::vector<std::string> sources;
+	std::vector<std::future<bool>> results;
+	for (const std::string &file : files)
+	{
+		if (isImageFile(file))
+		{
+			sources.push_back(file);
+			results.push_back(ThreadPool::Shared().Submit([file, options]() { return Bake(file, options); }));
+		}
+	}
+
+	unsigned int failed = 0;
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		if (!results[i].get())
+		{
+			std::cout << "ERROR::BAKED_TEXTURE::FAILED_TO_BAKE " << sources[i] << std::endl;
+			failed++;
+		}
+	}
+	double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	std::cout << "BAKED_TEXTURE::baked " << sources.size() - failed << " of " << sources.size() << " textures in "
+		<< milliseconds << " ms" << std::endl;
+	return failed;
+}
+
+// maps the bake and checks it against the source, false when it's missing, stale or corrupt
+static bool openBake(const std::string &sourcePath, MappedFile &file)
+{
+	if (!file.Open(BakedTexture::BakedPath(sourcePath)))
+	{
+		return false;
+	}
+
+	const unsigned char *data = file.Data();
+	size_t size = file.Size();
+	if (size < sizeof(BakedTextureHeader))
+	{
+		file.Close();
+		return false;
+	}
+
+	const BakedTextureHeader *bakedHeader = reinterpret_cast<const BakedTextureHeader*>(data);
+	bool valid = std::memcmp(bakedHeader->magic, BAKED_TEXTURE_MAGIC, sizeof(BAKED_TEXTURE_MAGIC)) == 0
+		&& bakedHeader->version == BAKED_TEXTURE_VERSION
+		&& bakedHeader->components >= 1 && bakedHeader->components <= 4
+		&& bakedHeader->levelCount >= 1
+		&& bakedHeader->blockFormat <= BLOCK_FORMAT_BC7
+		&& bakedHeader->sourcePathHash == hashString(TextureManager::CanonicalPath(sourcePath))
+		&& bakedHeader->sourceModified == sourceModifiedTime(sourcePath)
+		&& sizeof(BakedTextureHeader) + (uint64_t)bakedHeader->levelCount * sizeof(BakedTextureLevel) <= size;
+
+	// make sure no level points outside of the file or has the wrong size
+	const BakedTextureLevel *levelIndex = reinterpret_cast<const BakedTextureLevel*>(data + sizeof(BakedTextureHeader));
+	BlockFormat blockFormat = (BlockFormat)bakedHeader->blockFormat;
+	for (uint32_t i = 0; valid && i < bakedHeader->levelCount; i++)
+	{
+		const BakedTextureLevel &level = levelIndex[i];
+		uint64_t expectedSize = blockFormat != BLOCK_FORMAT_NONE
+			? CompressedImageSize(blockFormat, (int)level.width, (int)level.height)
+			: (uint64_t)level.width * level.height * bakedHeader->components;
+		valid = level.offset >= levelIndex[0].offset
+			&& level.offset + level.size <= size
+			&& level.size == expectedSize;
+	}
+	if (!valid)
+	{
+		file.Close();
+	}
+	return valid;
+}
+
+bool BakedTexture::IsCurrent(const std::string &sourcePath)
+{
+	MappedFile file;
+	return openBake(sourcePath, file);
+}
+
+bool BakedTexture::Load(const std::string &sourcePath, TextureImage &image)
+{
+	std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+	if (!openBake(sourcePath, *file))
+	{
+		return false;
+	}
+
+	const unsigned char *data = file->Data();
+	const BakedTextureHeader *bakedHeader = reinterpret_cast<const BakedTextureHeader*>(data);
+	const BakedTextureLevel *levelIndex = reinterpret_cast<const BakedTextureLevel*>(data + sizeof(BakedTextureHeader));
+	BlockFormat blockFormat = (BlockFormat)bakedHeader->blockFormat;
+	if (blockFormat != BLOCK_FORMAT_NONE && !IsBlockFormatSupported(blockFormat))
+	{
+		return false;
+	}
+
+	image.width = (int)bakedHeader->width;
+	image.height = (int)bakedHeader->height;
+	image.nrComponents = (int)bakedHeader->components;
+	image.contentHash = bakedHeader->contentHash;
+	image.compressedFormat = BlockFormatInternalFormat(blockFormat);
+	image.levels.clear();
+	for (uint32_t i = 0; i < bakedHeader->levelCount; i++)
+	{
+		TextureLevel level;
+		level.width = (int)levelIndex[i].width;
+		level.height = (int)levelIndex[i].height;
+		level.offset = (size_t)(levelIndex[i].offset - levelIndex[0].offset);
+		level.size = (size_t)levelIndex[i].size;
+		image.levels.push_back(level);
+	}
+	// the pixels stay in the mapping, which lives as long as the image data is referenced
+	unsigned char *levels = const_cast<unsigned char*>(data + levelIndex[0].offset);
+	image.data = std::shared_ptr<unsigned char>(file, levels);
+	return true;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "TextureManager.h"
+#include "BlockCompression.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Offline baked textures, written next to the source image as "<image>.btex". Laid out like a KTX2
+// file: a header, an index with one entry per mip level, then the levels themselves, largest first,
+// each 16 byte aligned, either plain pixels or BCn blocks. The runtime maps the file and uploads the
+// levels as they are, instead of decoding the image and generating mipmaps on the GPU. A bake is only
+// used while the source path and modification time match, so editing a texture falls back to the
+// source until it's baked again, and only when the context supports its block format.
+
+const uint32_t BAKED_TEXTURE_VERSION = 2;
+
+enum BakedTextureFlags {
+	BAKED_TEXTURE_SRGB = 1 << 0		// color data, mips were filtered in linear space
+};
+
+enum MipFilter {
+	MIP_FILTER_BOX,		// 2x2 average, fast
+	MIP_FILTER_KAISER	// 6 tap Kaiser windowed sinc, keeps more detail without ringing
+};
+
+struct BakedTextureHeader {
+	char magic[4];
+	uint32_t version;
+	uint64_t sourceModified;
+	uint64_t sourcePathHash;
+	uint64_t contentHash;		// TextureImage::contentHash of the source pixels
+	uint32_t width;
+	uint32_t height;
+	uint32_t components;
+	uint32_t levelCount;
+	uint32_t flags;
+	uint32_t blockFormat;		// BlockFormat of every level
+};
+
+struct BakedTextureLevel {
+	uint64_t offset;
+	uint64_t size;
+	uint32_t width;
+	uint32_t height;
+};
+
+struct TextureBakeOptions {
+	MipFilter filter = MIP_FILTER_KAISER;
+	// RGB(A) images are block compressed: BC5 for normal maps, BC1 (opaque) or BC3 (alpha) for the rest,
+	// BC7 instead of both with COMPRESSION_HIGH. one and two channel images stay uncompressed
+	bool compress = true;
+	CompressionQuality quality = COMPRESSION_NORMAL;
+	// fall back to uncompressed levels for block formats the current context can't sample, for bakes made at runtime
+	bool supportedFormatsOnly = false;
+};
+
+class BakedTexture
+{
+public:
+	/* Functions */
+	// returns the baked file used for a source image
+	static std::string BakedPath(const std::string &sourcePath);
+
+	// decodes the source, builds the whole mip chain and writes the baked file
+	static bool Bake(const std::string &sourcePath, const TextureBakeOptions &options = TextureBakeOptions());
+	// bakes every image below the given directories on the thread pool, returns how many failed
+	static unsigned int BakeDirectories(const std::vector<std::string> &directories, const TextureBakeOptions &options = TextureBakeOptions());
+
+	// maps the bake of sourcePath into image (data points into the mapping), false when it's missing, stale,
+	// corrupt or in a block format the context doesn't support
+	static bool Load(const std::string &sourcePath, TextureImage &image);
+	// true when there's a bake for the current source, whether or not it can be loaded
+	static bool IsCurrent(const std::string &sourcePath);
+
+	// bake images that have no current bake while they're decoded, so the next run loads them mapped.
+	// set up before loading anything
+	static void EnableBakeOnImport(const TextureBakeOptions &options);
+	static bool BakeOnImport(TextureBakeOptions &options);
+
+	// whether an image holds color (filtered and stored as sRGB) rather than normals, masks or other data, by file name
+	static bool IsColorTexture(const std::string &path);
+	static bool IsNormalMap(const std::string &path);
+};
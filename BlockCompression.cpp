@@ -0,0 +1,940 @@
+#include "BlockCompression.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <limits>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BLOCK_SSE
+#endif
+
+// one 4x4 block, channel by channel so four pixels fit one SSE register
+struct PixelBlock {
+	float channels[4][16];
+};
+
+static void fetchBlock(const unsigned char *rgba, int width, int height, int blockX, int blockY, PixelBlock &block)
+{
+	for (int y = 0; y < 4; y++)
+	{
+		int sourceY = std::min(blockY * 4 + y, height - 1);
+		for (int x = 0; x < 4; x++)
+		{
+			int sourceX = std::min(blockX * 4 + x, width - 1);
+			const unsigned char *pixel = rgba + ((size_t)sourceY * width + sourceX) * 4;
+			for (int c = 0; c < 4; c++)
+			{
+				block.channels[c][y * 4 + x] = pixel[c];
+			}
+		}
+	}
+}
+
+// picks the closest palette entry for every pixel over the first channelCount channels, returns the summed squared error
+static float fitIndices(const PixelBlock &block, int channelCount, const float (*palette)[4], int paletteSize, int indices[16])
+{
+	float total = 0.0f;
+#ifdef BLOCK_SSE
+	for (int group = 0; group < 16; group += 4)
+	{
+		__m128 best = _mm_set1_ps(FLT_MAX);
+		__m128 bestIndex = _mm_setzero_ps();
+		for (int p = 0; p < paletteSize; p++)
+		{
+			__m128 distance = _mm_setzero_ps();
+			for (int c = 0; c < channelCount; c++)
+			{
+				__m128 delta = _mm_sub_ps(_mm_loadu_ps(&block.channels[c][group]), _mm_set1_ps(palette[p][c]));
+				distance = _mm_add_ps(distance, _mm_mul_ps(delta, delta));
+			}
+			__m128 closer = _mm_cmplt_ps(distance, best);
+			best = _mm_min_ps(distance, best);
+			bestIndex = _mm_or_ps(_mm_and_ps(closer, _mm_set1_ps((float)p)), _mm_andnot_ps(closer, bestIndex));
+		}
+		float errors[4], found[4];
+		_mm_storeu_ps(errors, best);
+		_mm_storeu_ps(found, bestIndex);
+		for (int i = 0; i < 4; i++)
+		{
+			indices[group + i] = (int)found[i];
+			total += errors[i];
+		}
+	}
+#else
+	for (int i = 0; i < 16; i++)
+	{
+		float best = FLT_MAX;
+		for (int p = 0; p < paletteSize; p++)
+		{
+			float distance = 0.0f;
+			for (int c = 0; c < channelCount; c++)
+			{
+				float delta = block.channels[c][i] - palette[p][c];
+				distance += delta * delta;
+			}
+			if (distance < best)
+			{
+				best = distance;
+				indices[i] = p;
+			}
+		}
+		total += best;
+	}
+#endif
+	return total;
+}
+
+/* Endpoint selection */
+
+// per channel minimum and maximum, inset a little and turned along the block's diagonal
+static void boundingBoxEndpoints(const PixelBlock &block, int channelCount, float start[4], float end[4])
+{
+	float mean[4] = {};
+	for (int c = 0; c < channelCount; c++)
+	{
+		start[c] = 255.0f;
+		end[c] = 0.0f;
+		for (int i = 0; i < 16; i++)
+		{
+			start[c] = std::min(start[c], block.channels[c][i]);
+			end[c] = std::max(end[c], block.channels[c][i]);
+			mean[c] += block.channels[c][i] / 16.0f;
+		}
+		float inset = (end[c] - start[c]) / 16.0f;
+		start[c] += inset;
+		end[c] -= inset;
+	}
+	// channels falling while the first one rises run from max to min
+	for (int c = 1; c < channelCount; c++)
+	{
+		float covariance = 0.0f;
+		for (int i = 0; i < 16; i++)
+		{
+			covariance += (block.channels[0][i] - mean[0]) * (block.channels[c][i] - mean[c]);
+		}
+		if (covariance < 0.0f)
+		{
+			std::swap(start[c], end[c]);
+		}
+	}
+}
+
+// the line through the mean along the direction of largest variance, clipped to the pixels' extent on it
+static void principalAxisEndpoints(const PixelBlock &block, int channelCount, float start[4], float end[4])
+{
+	float mean[4] = {};
+	for (int c = 0; c < channelCount; c++)
+	{
+		for (int i = 0; i < 16; i++)
+		{
+			mean[c] += block.channels[c][i];
+		}
+		mean[c] /= 16.0f;
+	}
+
+	float covariance[4][4] = {};
+	for (int i = 0; i < 16; i++)
+	{
+		for (int a = 0; a < channelCount; a++)
+		{
+			for (int b = a; b < channelCount; b++)
+			{
+				covariance[a][b] += (block.channels[a][i] - mean[a]) * (block.channels[b][i] - mean[b]);
+			}
+		}
+	}
+
+	// power iteration, starting from the channel with the most variance
+	float axis[4] = {};
+	int widest = 0;
+	for (int a = 0; a < channelCount; a++)
+	{
+		for (int b = 0; b < a; b++)
+		{
+			covariance[a][b] = covariance[b][a];
+		}
+		if (covariance[a][a] > covariance[widest][widest])
+		{
+			widest = a;
+		}
+	}
+	axis[widest] = 1.0f;
+	for (int iteration = 0; iteration < 8; iteration++)
+	{
+		float next[4] = {};
+		float length = 0.0f;
+		for (int a = 0; a < channelCount; a++)
+		{
+			for (int b = 0; b < channelCount; b++)
+			{
+				next[a] += covariance[a][b] * axis[b];
+			}
+			length += next[a] * next[a];
+		}
+		if (length < 1e-12f)
+		{
+			break;
+		}
+		length = std::sqrt(length);
+		for (int a = 0; a < channelCount; a++)
+		{
+			axis[a] = next[a] / length;
+		}
+	}
+
+	float minimum = FLT_MAX;
+	float maximum = -FLT_MAX;
+	for (int i = 0; i < 16; i++)
+	{
+		float t = 0.0f;
+		for (int c = 0; c < channelCount; c++)
+		{
+			t += (block.channels[c][i] - mean[c]) * axis[c];
+		}
+		minimum = std::min(minimum, t);
+		maximum = std::max(maximum, t);
+	}
+	for (int c = 0; c < channelCount; c++)
+	{
+		start[c] = std::min(std::max(mean[c] + axis[c] * minimum, 0.0f), 255.0f);
+		end[c] = std::min(std::max(mean[c] + axis[c] * maximum, 0.0f), 255.0f);
+	}
+}
+
+// least squares endpoints for fixed interpolation weights (0 = start, 1 = end), false when they're all the same
+static bool refineEndpoints(const PixelBlock &block, int channelCount, const float weights[16], float start[4], float end[4])
+{
+	float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+	float sa[4] = {}, sb[4] = {};
+	for (int i = 0; i < 16; i++)
+	{
+		float b = weights[i];
+		float a = 1.0f - b;
+		aa += a * a;
+		ab += a * b;
+		bb += b * b;
+		for (int c = 0; c < channelCount; c++)
+		{
+			sa[c] += a * block.channels[c][i];
+			sb[c] += b * block.channels[c][i];
+		}
+	}
+	float determinant = aa * bb - ab * ab;
+	if (std::fabs(determinant) < 1e-6f)
+	{
+		return false;
+	}
+	for (int c = 0; c < channelCount; c++)
+	{
+		start[c] = std::min(std::max((bb * sa[c] - ab * sb[c]) / determinant, 0.0f), 255.0f);
+		end[c] = std::min(std::max((aa * sb[c] - ab * sa[c]) / determinant, 0.0f), 255.0f);
+	}
+	return true;
+}
+
+static void selectEndpoints(const PixelBlock &block, int channelCount, CompressionQuality quality, float start[4], float end[4])
+{
+	if (quality == COMPRESSION_FAST)
+	{
+		boundingBoxEndpoints(block, channelCount, start, end);
+	}
+	else
+	{
+		principalAxisEndpoints(block, channelCount, start, end);
+	}
+}
+
+static int refinementPasses(CompressionQuality quality)
+{
+	return quality == COMPRESSION_FAST ? 0 : quality == COMPRESSION_NORMAL ? 1 : 8;
+}
+
+/* BC1 */
+
+static uint16_t packColor565(const float color[4])
+{
+	int r = (int)(color[0] * 31.0f / 255.0f + 0.5f);
+	int g = (int)(color[1] * 63.0f / 255.0f + 0.5f);
+	int b = (int)(color[2] * 31.0f / 255.0f + 0.5f);
+	return (uint16_t)((std::min(r, 31) << 11) | (std::min(g, 63) << 5) | std::min(b, 31));
+}
+
+static void unpackColor565(uint16_t packed, int color[3])
+{
+	int r = (packed >> 11) & 31;
+	int g = (packed >> 5) & 63;
+	int b = packed & 31;
+	color[0] = (r << 3) | (r >> 2);
+	color[1] = (g << 2) | (g >> 4);
+	color[2] = (b << 3) | (b >> 2);
+}
+
+// the four color palette, also used when color0 <= color1 would put the decoder in three color mode
+static void colorPalette(uint16_t color0, uint16_t color1, bool fourColors, int palette[4][3])
+{
+	unpackColor565(color0, palette[0]);
+	unpackColor565(color1, palette[1]);
+	for (int c = 0; c < 3; c++)
+	{
+		if (fourColors)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+		else
+		{
+			palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+			palette[3][c] = 0;
+		}
+	}
+}
+
+static float fitColors(const PixelBlock &block, uint16_t color0, uint16_t color1, int indices[16])
+{
+	int palette[4][3];
+	colorPalette(color0, color1, true, palette);
+	float paletteFloat[4][4] = {};
+	for (int p = 0; p < 4; p++)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			paletteFloat[p][c] = (float)palette[p][c];
+		}
+	}
+	return fitIndices(block, 3, paletteFloat, 4, indices);
+}
+
+static void encodeColorBlock(const PixelBlock &block, CompressionQuality quality, unsigned char *out)
+{
+	// fraction of the way from color0 to color1 for each index
+	static const float colorWeights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+
+	float start[4], end[4];
+	selectEndpoints(block, 3, quality, start, end);
+	uint16_t color0 = packColor565(start);
+	uint16_t color1 = packColor565(end);
+	int indices[16];
+	float error = fitColors(block, color0, color1, indices);
+
+	for (int pass = 0; pass < refinementPasses(quality); pass++)
+	{
+		float weights[16];
+		for (int i = 0; i < 16; i++)
+		{
+			weights[i] = colorWeights[indices[i]];
+		}
+		if (!refineEndpoints(block, 3, weights, start, end))
+		{
+			break;
+		}
+		uint16_t refined0 = packColor565(start);
+		uint16_t refined1 = packColor565(end);
+		if (refined0 == color0 && refined1 == color1)
+		{
+			break;
+		}
+		int refinedIndices[16];
+		float refinedError = fitColors(block, refined0, refined1, refinedIndices);
+		if (refinedError >= error)
+		{
+			break;
+		}
+		color0 = refined0;
+		color1 = refined1;
+		error = refinedError;
+		std::memcpy(indices, refinedIndices, sizeof(indices));
+	}
+
+	// four color mode needs color0 > color1
+	if (color0 < color1)
+	{
+		static const int swapped[4] = { 1, 0, 3, 2 };
+		std::swap(color0, color1);
+		for (int i = 0; i < 16; i++)
+		{
+			indices[i] = swapped[indices[i]];
+		}
+	}
+	else if (color0 == color1)
+	{
+		// three color mode, but index 0 is the only color anyway
+		for (int i = 0; i < 16; i++)
+		{
+			indices[i] = 0;
+		}
+	}
+
+	uint32_t bits = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		bits |= (uint32_t)indices[i] << (2 * i);
+	}
+	out[0] = (unsigned char)(color0 & 0xff);
+	out[1] = (unsigned char)(color0 >> 8);
+	out[2] = (unsigned char)(color1 & 0xff);
+	out[3] = (unsigned char)(color1 >> 8);
+	std::memcpy(out + 4, &bits, sizeof(bits));
+}
+
+static void decodeColorBlock(const unsigned char *in, bool alwaysFourColors, unsigned char pixels[16][4])
+{
+	uint16_t color0 = (uint16_t)(in[0] | (in[1] << 8));
+	uint16_t color1 = (uint16_t)(in[2] | (in[3] << 8));
+	uint32_t bits;
+	std::memcpy(&bits, in + 4, sizeof(bits));
+	int palette[4][3];
+	colorPalette(color0, color1, alwaysFourColors || color0 > color1, palette);
+	for (int i = 0; i < 16; i++)
+	{
+		int index = (bits >> (2 * i)) & 3;
+		for (int c = 0; c < 3; c++)
+		{
+			pixels[i][c] = (unsigned char)palette[index][c];
+		}
+	}
+}
+
+/* BC4, the alpha block of BC3 and both halves of BC5 */
+
+static void channelPalette(int value0, int value1, int palette[8])
+{
+	palette[0] = value0;
+	palette[1] = value1;
+	if (value0 > value1)
+	{
+		for (int i = 2; i < 8; i++)
+		{
+			palette[i] = ((8 - i) * value0 + (i - 1) * value1) / 7;
+		}
+	}
+	else
+	{
+		for (int i = 2; i < 6; i++)
+		{
+			palette[i] = ((6 - i) * value0 + (i - 1) * value1) / 5;
+		}
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+}
+
+static float fitChannel(const PixelBlock &values, int value0, int value1, int indices[16])
+{
+	int palette[8];
+	channelPalette(value0, value1, palette);
+	float paletteFloat[8][4] = {};
+	for (int p = 0; p < 8; p++)
+	{
+		paletteFloat[p][0] = (float)palette[p];
+	}
+	return fitIndices(values, 1, paletteFloat, 8, indices);
+}
+
+static void encodeChannelBlock(const PixelBlock &block, int channel, CompressionQuality quality, unsigned char *out)
+{
+	PixelBlock values;
+	std::memcpy(values.channels[0], block.channels[channel], sizeof(values.channels[0]));
+
+	int minimum = 255, maximum = 0;
+	int innerMinimum = 255, innerMaximum = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		int value = (int)values.channels[0][i];
+		minimum = std::min(minimum, value);
+		maximum = std::max(maximum, value);
+		if (value != 0 && value != 255)
+		{
+			innerMinimum = std::min(innerMinimum, value);
+			innerMaximum = std::max(innerMaximum, value);
+		}
+	}
+
+	int value0 = maximum, value1 = minimum;
+	int indices[16];
+	float error = fitChannel(values, value0, value1, indices);
+	if (maximum > minimum && quality != COMPRESSION_FAST)
+	{
+		// pulling the ends in trades the extremes for finer steps in between
+		int reach = quality == COMPRESSION_HIGH ? 4 : 1;
+		for (int high = maximum; high >= std::max(minimum + 1, maximum - reach); high--)
+		{
+			for (int low = minimum; low <= std::min(high - 1, minimum + reach); low++)
+			{
+				int candidate[16];
+				float candidateError = fitChannel(values, high, low, candidate);
+				if (candidateError < error)
+				{
+					error = candidateError;
+					value0 = high;
+					value1 = low;
+					std::memcpy(indices, candidate, sizeof(indices));
+				}
+			}
+		}
+	}
+	if (quality == COMPRESSION_HIGH && innerMinimum <= innerMaximum && (minimum == 0 || maximum == 255))
+	{
+		// six value mode has exact 0 and 255 next to the interpolated range
+		int candidate[16];
+		float candidateError = fitChannel(values, innerMinimum, innerMaximum, candidate);
+		if (candidateError < error)
+		{
+			error = candidateError;
+			value0 = innerMinimum;
+			value1 = innerMaximum;
+			std::memcpy(indices, candidate, sizeof(indices));
+		}
+	}
+
+	uint64_t bits = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		bits |= (uint64_t)indices[i] << (3 * i);
+	}
+	out[0] = (unsigned char)value0;
+	out[1] = (unsigned char)value1;
+	for (int i = 0; i < 6; i++)
+	{
+		out[2 + i] = (unsigned char)(bits >> (8 * i));
+	}
+}
+
+static void decodeChannelBlock(const unsigned char *in, int channel, unsigned char pixels[16][4])
+{
+	int palette[8];
+	channelPalette(in[0], in[1], palette);
+	uint64_t bits = 0;
+	for (int i = 0; i < 6; i++)
+	{
+		bits |= (uint64_t)in[2 + i] << (8 * i);
+	}
+	for (int i = 0; i < 16; i++)
+	{
+		pixels[i][channel] = (unsigned char)palette[(bits >> (3 * i)) & 7];
+	}
+}
+
+/* BC7, mode 6 only: one subset, RGBA endpoints of 7 bits plus a p-bit each, 4 bit indices */
+
+static const int BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+static void quantizeEndpoint(const float endpoint[4], int pbit, int quantized[4])
+{
+	for (int c = 0; c < 4; c++)
+	{
+		int value = (int)((endpoint[c] - pbit) / 2.0f + 0.5f);
+		quantized[c] = std::min(std::max(value, 0), 127);
+	}
+}
+
+// the p-bit that lands closest to the endpoint after quantization
+static int bestPbit(const float endpoint[4])
+{
+	float errors[2] = { 0.0f, 0.0f };
+	for (int pbit = 0; pbit < 2; pbit++)
+	{
+		int quantized[4];
+		quantizeEndpoint(endpoint, pbit, quantized);
+		for (int c = 0; c < 4; c++)
+		{
+			float delta = endpoint[c] - (float)((quantized[c] << 1) | pbit);
+			errors[pbit] += delta * delta;
+		}
+	}
+	return errors[1] < errors[0] ? 1 : 0;
+}
+
+static void bc7Palette(const int quantized0[4], int pbit0, const int quantized1[4], int pbit1, int palette[16][4])
+{
+	for (int c = 0; c < 4; c++)
+	{
+		int value0 = (quantized0[c] << 1) | pbit0;
+		int value1 = (quantized1[c] << 1) | pbit1;
+		for (int i = 0; i < 16; i++)
+		{
+			palette[i][c] = ((64 - BC7_WEIGHTS[i]) * value0 + BC7_WEIGHTS[i] * value1 + 32) >> 6;
+		}
+	}
+}
+
+struct Bc7Endpoints {
+	int quantized[2][4];
+	int pbits[2];
+};
+
+static float fitBc7(const PixelBlock &block, const Bc7Endpoints &endpoints, int indices[16])
+{
+	int palette[16][4];
+	bc7Palette(endpoints.quantized[0], endpoints.pbits[0], endpoints.quantized[1], endpoints.pbits[1], palette);
+	float paletteFloat[16][4];
+	for (int p = 0; p < 16; p++)
+	{
+		for (int c = 0; c < 4; c++)
+		{
+			paletteFloat[p][c] = (float)palette[p][c];
+		}
+	}
+	return fitIndices(block, 4, paletteFloat, 16, indices);
+}
+
+// quantizes both endpoints, high quality tries every p-bit pair instead of the closest ones
+static float quantizeBc7(const PixelBlock &block, const float start[4], const float end[4], CompressionQuality quality,
+	Bc7Endpoints &endpoints, int indices[16])
+{
+	if (quality != COMPRESSION_HIGH)
+	{
+		endpoints.pbits[0] = bestPbit(start);
+		endpoints.pbits[1] = bestPbit(end);
+		quantizeEndpoint(start, endpoints.pbits[0], endpoints.quantized[0]);
+		quantizeEndpoint(end, endpoints.pbits[1], endpoints.quantized[1]);
+		return fitBc7(block, endpoints, indices);
+	}
+
+	float best = FLT_MAX;
+	for (int combination = 0; combination < 4; combination++)
+	{
+		Bc7Endpoints candidate;
+		candidate.pbits[0] = combination & 1;
+		candidate.pbits[1] = combination >> 1;
+		quantizeEndpoint(start, candidate.pbits[0], candidate.quantized[0]);
+		quantizeEndpoint(end, candidate.pbits[1], candidate.quantized[1]);
+		int candidateIndices[16];
+		float error = fitBc7(block, candidate, candidateIndices);
+		if (error < best)
+		{
+			best = error;
+			endpoints = candidate;
+			std::memcpy(indices, candidateIndices, sizeof(candidateIndices));
+		}
+	}
+	return best;
+}
+
+static void putBits(unsigned char *out, int &position, uint32_t value, int count)
+{
+	for (int i = 0; i < count; i++, position++)
+	{
+		if ((value >> i) & 1)
+		{
+			out[position >> 3] |= (unsigned char)(1 << (position & 7));
+		}
+	}
+}
+
+static uint32_t getBits(const unsigned char *in, int &position, int count)
+{
+	uint32_t value = 0;
+	for (int i = 0; i < count; i++, position++)
+	{
+		value |= (uint32_t)((in[position >> 3] >> (position & 7)) & 1) << i;
+	}
+	return value;
+}
+
+static void encodeBc7Block(const PixelBlock &block, CompressionQuality quality, unsigned char *out)
+{
+	float start[4], end[4];
+	selectEndpoints(block, 4, quality, start, end);
+	Bc7Endpoints endpoints;
+	int indices[16];
+	float error = quantizeBc7(block, start, end, quality, endpoints, indices);
+
+	for (int pass = 0; pass < refinementPasses(quality); pass++)
+	{
+		float weights[16];
+		for (int i = 0; i < 16; i++)
+		{
+			weights[i] = BC7_WEIGHTS[indices[i]] / 64.0f;
+		}
+		if (!refineEndpoints(block, 4, weights, start, end))
+		{
+			break;
+		}
+		Bc7Endpoints refined;
+		int refinedIndices[16];
+		float refinedError = quantizeBc7(block, start, end, quality, refined, refinedIndices);
+		if (refinedError >= error)
+		{
+			break;
+		}
+		error = refinedError;
+		endpoints = refined;
+		std::memcpy(indices, refinedIndices, sizeof(indices));
+	}
+
+	// the first index is stored without its top bit, so it has to be in the lower half
+	if (indices[0] >= 8)
+	{
+		std::swap(endpoints.quantized[0], endpoints.quantized[1]);
+		std::swap(endpoints.pbits[0], endpoints.pbits[1]);
+		for (int i = 0; i < 16; i++)
+		{
+			indices[i] = 15 - indices[i];
+		}
+	}
+
+	std::memset(out, 0, 16);
+	int position = 0;
+	putBits(out, position, 1 << 6, 7);
+	for (int c = 0; c < 4; c++)
+	{
+		putBits(out, position, (uint32_t)endpoints.quantized[0][c], 7);
+		putBits(out, position, (uint32_t)endpoints.quantized[1][c], 7);
+	}
+	putBits(out, position, (uint32_t)endpoints.pbits[0], 1);
+	putBits(out, position, (uint32_t)endpoints.pbits[1], 1);
+	for (int i = 0; i < 16; i++)
+	{
+		putBits(out, position, (uint32_t)indices[i], i == 0 ? 3 : 4);
+	}
+}
+
+static void decodeBc7Block(const unsigned char *in, unsigned char pixels[16][4])
+{
+	int position = 0;
+	if (getBits(in, position, 7) != (1 << 6))
+	{
+		// not a mode this encoder writes
+		for (int i = 0; i < 16; i++)
+		{
+			pixels[i][0] = 255;
+			pixels[i][1] = 0;
+			pixels[i][2] = 255;
+			pixels[i][3] = 255;
+		}
+		return;
+	}
+
+	int quantized[2][4];
+	for (int c = 0; c < 4; c++)
+	{
+		quantized[0][c] = (int)getBits(in, position, 7);
+		quantized[1][c] = (int)getBits(in, position, 7);
+	}
+	int pbit0 = (int)getBits(in, position, 1);
+	int pbit1 = (int)getBits(in, position, 1);
+	int palette[16][4];
+	bc7Palette(quantized[0], pbit0, quantized[1], pbit1, palette);
+	for (int i = 0; i < 16; i++)
+	{
+		int index = (int)getBits(in, position, i == 0 ? 3 : 4);
+		for (int c = 0; c < 4; c++)
+		{
+			pixels[i][c] = (unsigned char)palette[index][c];
+		}
+	}
+}
+
+/* Images */
+
+static void encodeBlock(const PixelBlock &block, BlockFormat format, CompressionQuality quality, unsigned char *out)
+{
+	switch (format)
+	{
+	case BLOCK_FORMAT_BC1:
+		encodeColorBlock(block, quality, out);
+		break;
+	case BLOCK_FORMAT_BC3:
+		encodeChannelBlock(block, 3, quality, out);
+		encodeColorBlock(block, quality, out + 8);
+		break;
+	case BLOCK_FORMAT_BC5:
+		encodeChannelBlock(block, 0, quality, out);
+		encodeChannelBlock(block, 1, quality, out + 8);
+		break;
+	case BLOCK_FORMAT_BC7:
+		encodeBc7Block(block, quality, out);
+		break;
+	default:
+		break;
+	}
+}
+
+const char *BlockFormatName(BlockFormat format)
+{
+	switch (format)
+	{
+	case BLOCK_FORMAT_BC1: return "BC1";
+	case BLOCK_FORMAT_BC3: return "BC3";
+	case BLOCK_FORMAT_BC5: return "BC5";
+	case BLOCK_FORMAT_BC7: return "BC7";
+	default: return "uncompressed";
+	}
+}
+
+GLenum BlockFormatInternalFormat(BlockFormat format)
+{
+	switch (format)
+	{
+	case BLOCK_FORMAT_BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	case BLOCK_FORMAT_BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	case BLOCK_FORMAT_BC5: return GL_COMPRESSED_RG_RGTC2;
+	case BLOCK_FORMAT_BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+	default: return 0;
+	}
+}
+
+size_t BlockFormatBlockSize(BlockFormat format)
+{
+	return format == BLOCK_FORMAT_BC1 ? 8 : format == BLOCK_FORMAT_NONE ? 0 : 16;
+}
+
+size_t CompressedImageSize(BlockFormat format, int width, int height)
+{
+	return (size_t)((width + 3) / 4) * ((height + 3) / 4) * BlockFormatBlockSize(format);
+}
+
+void CompressImage(const unsigned char *rgba, int width, int height, BlockFormat format, CompressionQuality quality, unsigned char *blocks)
+{
+	int blocksX = (width + 3) / 4;
+	int blocksY = (height + 3) / 4;
+	size_t blockSize = BlockFormatBlockSize(format);
+	auto compressRows = [=](int firstRow, int endRow) {
+		PixelBlock block;
+		for (int blockY = firstRow; blockY < endRow; blockY++)
+		{
+			for (int blockX = 0; blockX < blocksX; blockX++)
+			{
+				fetchBlock(rgba, width, height, blockX, blockY, block);
+				encodeBlock(block, format, quality, blocks + ((size_t)blockY * blocksX + blockX) * blockSize);
+			}
+		}
+	};
+
+	// a worker waiting for other jobs could wait forever when every worker does the same
+	ThreadPool &pool = ThreadPool::Shared();
+	if (pool.IsWorkerThread() || blocksY < 8)
+	{
+		compressRows(0, blocksY);
+		return;
+	}
+
+	// a few jobs per worker evens out blocks that take longer, this thread does the last one
+	int jobCount = std::min(blocksY, (int)pool.ThreadCount() * 4 + 1);
+	std::vector<std::future<void>> jobs;
+	for (int job = 0; job < jobCount - 1; job++)
+	{
+		int firstRow = blocksY * job / jobCount;
+		int endRow = blocksY * (job + 1) / jobCount;
+		jobs.push_back(pool.Submit([=]() { compressRows(firstRow, endRow); }));
+	}
+	compressRows(blocksY * (jobCount - 1) / jobCount, blocksY);
+	for (std::future<void> &job : jobs)
+	{
+		job.get();
+	}
+}
+
+void DecompressImage(const unsigned char *blocks, int width, int height, BlockFormat format, unsigned char *rgba)
+{
+	int blocksX = (width + 3) / 4;
+	int blocksY = (height + 3) / 4;
+	size_t blockSize = BlockFormatBlockSize(format);
+	for (int blockY = 0; blockY < blocksY; blockY++)
+	{
+		for (int blockX = 0; blockX < blocksX; blockX++)
+		{
+			const unsigned char *block = blocks + ((size_t)blockY * blocksX + blockX) * blockSize;
+			unsigned char pixels[16][4];
+			for (int i = 0; i < 16; i++)
+			{
+				pixels[i][0] = pixels[i][1] = pixels[i][2] = 0;
+				pixels[i][3] = 255;
+			}
+			switch (format)
+			{
+			case BLOCK_FORMAT_BC1:
+				decodeColorBlock(block, false, pixels);
+				break;
+			case BLOCK_FORMAT_BC3:
+				decodeChannelBlock(block, 3, pixels);
+				decodeColorBlock(block + 8, true, pixels);
+				break;
+			case BLOCK_FORMAT_BC5:
+				decodeChannelBlock(block, 0, pixels);
+				decodeChannelBlock(block + 8, 1, pixels);
+				break;
+			case BLOCK_FORMAT_BC7:
+				decodeBc7Block(block, pixels);
+				break;
+			default:
+				break;
+			}
+
+			for (int y = 0; y < 4 && blockY * 4 + y < height; y++)
+			{
+				for (int x = 0; x < 4 && blockX * 4 + x < width; x++)
+				{
+					std::memcpy(rgba + ((size_t)(blockY * 4 + y) * width + blockX * 4 + x) * 4, pixels[y * 4 + x], 4);
+				}
+			}
+		}
+	}
+}
+
+double ComputePSNR(const unsigned char *rgbaA, const unsigned char *rgbaB, int width, int height, int channels)
+{
+	double squaredError = 0.0;
+	size_t pixelCount = (size_t)width * height;
+	for (size_t i = 0; i < pixelCount; i++)
+	{
+		for (int c = 0; c < channels; c++)
+		{
+			double delta = (double)rgbaA[i * 4 + c] - (double)rgbaB[i * 4 + c];
+			squaredError += delta * delta;
+		}
+	}
+	if (squaredError == 0.0)
+	{
+		return std::numeric_limits<double>::infinity();
+	}
+	double meanSquaredError = squaredError / ((double)pixelCount * channels);
+	return 10.0 * std::log10(255.0 * 255.0 / meanSquaredError);
+}
+
+// one bit per BlockFormat
+static std::atomic<unsigned int> supportedFormats{ 0 };
+
+void DetectBlockFormatSupport()
+{
+	// RGTC is core since GL 3.0
+	unsigned int supported = 1u << BLOCK_FORMAT_BC5;
+	GLint extensionCount = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+	for (GLint i = 0; i < extensionCount; i++)
+	{
+		const char *name = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, (GLuint)i));
+		if (!name)
+		{
+			continue;
+		}
+		if (std::strcmp(name, "GL_EXT_texture_compression_s3tc") == 0)
+		{
+			supported |= (1u << BLOCK_FORMAT_BC1) | (1u << BLOCK_FORMAT_BC3);
+		}
+		else if (std::strcmp(name, "GL_ARB_texture_compression_bptc") == 0)
+		{
+			supported |= 1u << BLOCK_FORMAT_BC7;
+		}
+	}
+#ifdef GL_VERSION_4_2
+	if (GLAD_GL_VERSION_4_2)
+	{
+		supported |= 1u << BLOCK_FORMAT_BC7;
+	}
+#endif
+	supportedFormats.store(supported);
+}
+
+bool IsBlockFormatSupported(BlockFormat format)
+{
+	return format != BLOCK_FORMAT_NONE && (supportedFormats.load() & (1u << format)) != 0;
+}
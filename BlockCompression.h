@@ -0,0 +1,54 @@
+#pragma once
+#include <glad/glad.h>
+
+#include <cstddef>
+
+// CPU encoder for the BCn block compressed formats. Images are compressed in 4x4 blocks, the edges
+// of images that aren't a multiple of 4 are padded by repeating the last row and column.
+
+// S3TC isn't part of core GL but every desktop driver has it, older glad headers leave the enums out
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_RG_RGTC2
+#define GL_COMPRESSED_RG_RGTC2 0x8DBD
+#endif
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#endif
+
+enum BlockFormat {
+	BLOCK_FORMAT_NONE,
+	BLOCK_FORMAT_BC1,	// RGB, 4 bits per pixel
+	BLOCK_FORMAT_BC3,	// RGB + interpolated alpha, 8 bits per pixel
+	BLOCK_FORMAT_BC5,	// two independent channels (normal map X and Y), 8 bits per pixel
+	BLOCK_FORMAT_BC7	// RGBA at higher quality than BC1/BC3, 8 bits per pixel
+};
+
+enum CompressionQuality {
+	COMPRESSION_FAST,	// bounding box endpoints, no refinement
+	COMPRESSION_NORMAL,	// principal axis endpoints refined once
+	COMPRESSION_HIGH	// principal axis endpoints refined until they stop improving, wider endpoint search
+};
+
+const char *BlockFormatName(BlockFormat format);
+GLenum BlockFormatInternalFormat(BlockFormat format);
+size_t BlockFormatBlockSize(BlockFormat format);
+// bytes of a compressed width x height image
+size_t CompressedImageSize(BlockFormat format, int width, int height);
+
+// compresses four channel pixels. BC5 takes red and green, BC1 ignores alpha. splits the blocks across the
+// shared thread pool, unless it's called from one of its workers, then the calling thread does all of them
+void CompressImage(const unsigned char *rgba, int width, int height, BlockFormat format, CompressionQuality quality, unsigned char *blocks);
+// the reverse, BC5 decodes into red and green with blue 0 and alpha 255
+void DecompressImage(const unsigned char *blocks, int width, int height, BlockFormat format, unsigned char *rgba);
+// peak signal to noise ratio in dB over the first channels of two four channel images, higher is better
+double ComputePSNR(const unsigned char *rgbaA, const unsigned char *rgbaB, int width, int height, int channels);
+
+// checks the context for the formats, call on the GL thread once GL is loaded.
+// until then, or without a context, no format counts as supported
+void DetectBlockFormatSupport();
+bool IsBlockFormatSupported(BlockFormat format);
@@ -0,0 +1,393 @@
+#include "Culling.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <random>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define CULLING_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CULLING_SSE
+#endif
+
+// the SIMD loops consume this many boxes per iteration, BoundsBatch pads to it
+static const size_t BATCH_WIDTH = 8;
+
+MeshBounds ComputeBounds(const std::vector<Vertex> &vertices)
+{
+	MeshBounds bounds;
+	if (vertices.empty())
+	{
+		bounds.box.min = glm::vec3(0.0f);
+		bounds.box.max = glm::vec3(0.0f);
+		bounds.sphere.center = glm::vec3(0.0f);
+		bounds.sphere.radius = 0.0f;
+		return bounds;
+	}
+
+	bounds.box.min = vertices[0].Position;
+	bounds.box.max = vertices[0].Position;
+	for (const Vertex &vertex : vertices)
+	{
+		bounds.box.min = glm::min(bounds.box.min, vertex.Position);
+		bounds.box.max = glm::max(bounds.box.max, vertex.Position);
+	}
+
+	// centred on the box, but with the radius of the farthest vertex instead of the box corner
+	bounds.sphere.center = (bounds.box.min + bounds.box.max) * 0.5f;
+	float radiusSquared = 0.0f;
+	for (const Vertex &vertex : vertices)
+	{
+		glm::vec3 offset = vertex.Position - bounds.sphere.center;
+		radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+	}
+	bounds.sphere.radius = std::sqrt(radiusSquared);
+	return bounds;
+}
+
+AABB TransformAABB(const AABB &box, const glm::mat4 &transform)
+{
+	glm::vec3 center = (box.min + box.max) * 0.5f;
+	glm::vec3 extent = (box.max - box.min) * 0.5f;
+
+	glm::vec4 transformedCenter = transform * glm::vec4(center, 1.0f);
+	glm::vec3 transformedExtent(0.0f);
+	for (int column = 0; column < 3; column++)
+	{
+		for (int row = 0; row < 3; row++)
+		{
+			transformedExtent[row] += std::fabs(transform[column][row]) * extent[column];
+		}
+	}
+
+	AABB result;
+	glm::vec3 newCenter(transformedCenter.x, transformedCenter.y, transformedCenter.z);
+	result.min = newCenter - transformedExtent;
+	result.max = newCenter + transformedExtent;
+	return result;
+}
+
+AABB EmptyAABB()
+{
+	AABB box;
+	box.min = glm::vec3(std::numeric_limits<float>::max());
+	box.max = glm::vec3(-std::numeric_limits<float>::max());
+	return box;
+}
+
+void GrowAABB(AABB &box, const AABB &other)
+{
+	box.min = glm::min(box.min, other.min);
+	box.max = glm::max(box.max, other.max);
+}
+
+void GrowAABB(AABB &box, const glm::vec3 &point)
+{
+	box.min = glm::min(box.min, point);
+	box.max = glm::max(box.max, point);
+}
+
+glm::vec3 AABBCenter(const AABB &box)
+{
+	return (box.min + box.max) * 0.5f;
+}
+
+float AABBSurfaceArea(const AABB &box)
+{
+	glm::vec3 size = box.max - box.min;
+	return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+float IntersectRayAABB(const AABB &box, const glm::vec3 &origin, const glm::vec3 &inverseDirection, float maxDistance)
+{
+	float tMin = 0.0f;
+	float tMax = maxDistance;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		float t1 = (box.min[axis] - origin[axis]) * inverseDirection[axis];
+		float t2 = (box.max[axis] - origin[axis]) * inverseDirection[axis];
+		tMin = std::max(tMin, std::min(t1, t2));
+		tMax = std::min(tMax, std::max(t1, t2));
+	}
+	return tMin <= tMax ? tMin : -1.0f;
+}
+
+void SweepSAHBins(const AABB *binBounds, const unsigned int *binCounts, int axis, SAHSplit &split)
+{
+	// sweep from both sides so every split plane is evaluated in linear time
+	float leftArea[SAH_MAX_BINS - 1];
+	unsigned int leftCount[SAH_MAX_BINS - 1];
+	AABB sweep = EmptyAABB();
+	unsigned int sweepCount = 0;
+	for (int b = 0; b < split.bins - 1; b++)
+	{
+		sweepCount += binCounts[b];
+		if (binCounts[b])
+		{
+			GrowAABB(sweep, binBounds[b]);
+		}
+		leftCount[b] = sweepCount;
+		leftArea[b] = sweepCount ? AABBSurfaceArea(sweep) : 0.0f;
+	}
+	sweep = EmptyAABB();
+	sweepCount = 0;
+	for (int b = split.bins - 1; b > 0; b--)
+	{
+		sweepCount += binCounts[b];
+		if (binCounts[b])
+		{
+			GrowAABB(sweep, binBounds[b]);
+		}
+		float cost = leftArea[b - 1] * leftCount[b - 1] + (sweepCount ? AABBSurfaceArea(sweep) * sweepCount : 0.0f);
+		if (leftCount[b - 1] > 0 && sweepCount > 0 && cost < split.cost)
+		{
+			split.cost = cost;
+			split.axis = axis;
+			split.bin = b;
+		}
+	}
+}
+
+Frustum ExtractFrustum(const glm::mat4 &m)
+{
+	// rows of the (column major) matrix
+	glm::vec4 rows[4];
+	for (int row = 0; row < 4; row++)
+	{
+		rows[row] = glm::vec4(m[0][row], m[1][row], m[2][row], m[3][row]);
+	}
+
+	Frustum frustum;
+	frustum.planes[0] = rows[3] + rows[0]; // left
+	frustum.planes[1] = rows[3] - rows[0]; // right
+	frustum.planes[2] = rows[3] + rows[1]; // bottom
+	frustum.planes[3] = rows[3] - rows[1]; // top
+	frustum.planes[4] = rows[3] + rows[2]; // near
+	frustum.planes[5] = rows[3] - rows[2]; // far
+
+	for (glm::vec4 &plane : frustum.planes)
+	{
+		float length = std::sqrt(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z);
+		if (length > 0.0f)
+		{
+			plane = plane / length;
+		}
+	}
+	return frustum;
+}
+
+bool IntersectsFrustum(const Frustum &frustum, const AABB &box)
+{
+	glm::vec3 center = (box.min + box.max) * 0.5f;
+	glm::vec3 extent = (box.max - box.min) * 0.5f;
+	for (const glm::vec4 &plane : frustum.planes)
+	{
+		float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+		float radius = std::fabs(plane.x) * extent.x + std::fabs(plane.y) * extent.y + std::fabs(plane.z) * extent.z;
+		if (distance + radius < 0.0f)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool IntersectsFrustum(const Frustum &frustum, const BoundingSphere &sphere)
+{
+	for (const glm::vec4 &plane : frustum.planes)
+	{
+		float distance = plane.x * sphere.center.x + plane.y * sphere.center.y + plane.z * sphere.center.z + plane.w;
+		if (distance < -sphere.radius)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void BoundsBatch::Clear()
+{
+	count = 0;
+	centerX.clear();
+	centerY.clear();
+	centerZ.clear();
+	extentX.clear();
+	extentY.clear();
+	extentZ.clear();
+}
+
+void BoundsBatch::Reserve(size_t count)
+{
+	size_t padded = (count + BATCH_WIDTH - 1) / BATCH_WIDTH * BATCH_WIDTH;
+	centerX.reserve(padded);
+	centerY.reserve(padded);
+	centerZ.reserve(padded);
+	extentX.reserve(padded);
+	extentY.reserve(padded);
+	extentZ.reserve(padded);
+}
+
+void BoundsBatch::Add(const AABB &box)
+{
+	if (count == centerX.size())
+	{
+		// grow by a whole SIMD group, the padding boxes are empty and their results ignored
+		size_t padded = count + BATCH_WIDTH;
+		centerX.resize(padded, 0.0f);
+		centerY.resize(padded, 0.0f);
+		centerZ.resize(padded, 0.0f);
+		extentX.resize(padded, 0.0f);
+		extentY.resize(padded, 0.0f);
+		extentZ.resize(padded, 0.0f);
+	}
+
+	centerX[count] = (box.min.x + box.max.x) * 0.5f;
+	centerY[count] = (box.min.y + box.max.y) * 0.5f;
+	centerZ[count] = (box.min.z + box.max.z) * 0.5f;
+	extentX[count] = (box.max.x - box.min.x) * 0.5f;
+	extentY[count] = (box.max.y - box.min.y) * 0.5f;
+	extentZ[count] = (box.max.z - box.min.z) * 0.5f;
+	count++;
+}
+
+void CullBatch(const Frustum &frustum, const BoundsBatch &batch, std::vector<unsigned char> &visible)
+{
+	size_t count = batch.Size();
+	size_t padded = batch.centerX.size();
+	visible.resize(padded);
+
+#if defined(CULLING_AVX)
+	for (size_t i = 0; i < padded; i += 8)
+	{
+		__m256 cx = _mm256_loadu_ps(&batch.centerX[i]);
+		__m256 cy = _mm256_loadu_ps(&batch.centerY[i]);
+		__m256 cz = _mm256_loadu_ps(&batch.centerZ[i]);
+		__m256 ex = _mm256_loadu_ps(&batch.extentX[i]);
+		__m256 ey = _mm256_loadu_ps(&batch.extentY[i]);
+		__m256 ez = _mm256_loadu_ps(&batch.extentZ[i]);
+
+		__m256 outside = _mm256_setzero_ps();
+		for (const glm::vec4 &plane : frustum.planes)
+		{
+			__m256 distance = _mm256_add_ps(
+				_mm256_add_ps(_mm256_mul_ps(cx, _mm256_set1_ps(plane.x)), _mm256_mul_ps(cy, _mm256_set1_ps(plane.y))),
+				_mm256_add_ps(_mm256_mul_ps(cz, _mm256_set1_ps(plane.z)), _mm256_set1_ps(plane.w)));
+			__m256 radius = _mm256_add_ps(
+				_mm256_add_ps(_mm256_mul_ps(ex, _mm256_set1_ps(std::fabs(plane.x))), _mm256_mul_ps(ey, _mm256_set1_ps(std::fabs(plane.y)))),
+				_mm256_mul_ps(ez, _mm256_set1_ps(std::fabs(plane.z))));
+			outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), _mm256_setzero_ps(), _CMP_LT_OQ));
+		}
+
+		int mask = _mm256_movemask_ps(outside);
+		for (int lane = 0; lane < 8; lane++)
+		{
+			visible[i + lane] = (mask >> lane) & 1 ? 0 : 1;
+		}
+	}
+#elif defined(CULLING_SSE)
+	for (size_t i = 0; i < padded; i += 4)
+	{
+		__m128 cx = _mm_loadu_ps(&batch.centerX[i]);
+		__m128 cy = _mm_loadu_ps(&batch.centerY[i]);
+		__m128 cz = _mm_loadu_ps(&batch.centerZ[i]);
+		__m128 ex = _mm_loadu_ps(&batch.extentX[i]);
+		__m128 ey = _mm_loadu_ps(&batch.extentY[i]);
+		__m128 ez = _mm_loadu_ps(&batch.extentZ[i]);
+
+		__m128 outside = _mm_setzero_ps();
+		for (const glm::vec4 &plane : frustum.planes)
+		{
+			__m128 distance = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(plane.x)), _mm_mul_ps(cy, _mm_set1_ps(plane.y))),
+				_mm_add_ps(_mm_mul_ps(cz, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+			__m128 radius = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(ex, _mm_set1_ps(std::fabs(plane.x))), _mm_mul_ps(ey, _mm_set1_ps(std::fabs(plane.y)))),
+				_mm_mul_ps(ez, _mm_set1_ps(std::fabs(plane.z))));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+		}
+
+		int mask = _mm_movemask_ps(outside);
+		for (int lane = 0; lane < 4; lane++)
+		{
+			visible[i + lane] = (mask >> lane) & 1 ? 0 : 1;
+		}
+	}
+#else
+	for (size_t i = 0; i < padded; i++)
+	{
+		AABB box;
+		box.min = glm::vec3(batch.centerX[i] - batch.extentX[i], batch.centerY[i] - batch.extentY[i], batch.centerZ[i] - batch.extentZ[i]);
+		box.max = glm::vec3(batch.centerX[i] + batch.extentX[i], batch.centerY[i] + batch.extentY[i], batch.centerZ[i] + batch.extentZ[i]);
+		visible[i] = IntersectsFrustum(frustum, box) ? 1 : 0;
+	}
+#endif
+
+	visible.resize(count);
+}
+
+void RunCullingBenchmark(const Frustum &frustum)
+{
+	const size_t boxCount = 100000;
+	const int runs = 20;
+
+	// random boxes in a 200 unit cube around the origin
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+	std::uniform_real_distribution<float> size(0.1f, 2.0f);
+
+	std::vector<AABB> boxes(boxCount);
+	BoundsBatch batch;
+	batch.Reserve(boxCount);
+	for (AABB &box : boxes)
+	{
+		glm::vec3 center(position(random), position(random), position(random));
+		glm::vec3 extent(size(random), size(random), size(random));
+		box.min = center - extent;
+		box.max = center + extent;
+		batch.Add(box);
+	}
+
+	typedef std::chrono::high_resolution_clock Clock;
+	double scalarBest = 1e9;
+	double batchBest = 1e9;
+	size_t scalarVisible = 0;
+	size_t batchVisible = 0;
+	std::vector<unsigned char> visible;
+
+	for (int run = 0; run < runs; run++)
+	{
+		Clock::time_point start = Clock::now();
+		scalarVisible = 0;
+		for (const AABB &box : boxes)
+		{
+			scalarVisible += IntersectsFrustum(frustum, box) ? 1 : 0;
+		}
+		Clock::time_point middle = Clock::now();
+		CullBatch(frustum, batch, visible);
+		Clock::time_point end = Clock::now();
+
+		batchVisible = 0;
+		for (unsigned char v : visible)
+		{
+			batchVisible += v;
+		}
+		scalarBest = std::min(scalarBest, std::chrono::duration<double, std::milli>(middle - start).count());
+		batchBest = std::min(batchBest, std::chrono::duration<double, std::milli>(end - middle).count());
+	}
+
+#if defined(CULLING_AVX)
+	const char *path = "AVX";
+#elif defined(CULLING_SSE)
+	const char *path = "SSE";
+#else
+	const char *path = "scalar";
+#endif
+	std::cout << "CULLING::BENCHMARK " << boxCount << " boxes, best of " << runs << std::endl;
+	std::cout << "  scalar: " << scalarBest << " ms, " << scalarVisible << " visible" << std::endl;
+	std::cout << "  batch (" << path << "): " << batchBest << " ms, " << batchVisible << " visible" << std::endl;
+}
@@ -0,0 +1,136 @@
+#pragma once
+#include <glm/glm.hpp>
+
+#include "Vertex.h"
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+struct AABB {
+	glm::vec3 min;
+	glm::vec3 max;
+};
+
+struct BoundingSphere {
+	glm::vec3 center;
+	float radius;
+};
+
+// object space bounds of a mesh, computed at import time
+struct MeshBounds {
+	AABB box;
+	BoundingSphere sphere;
+};
+
+MeshBounds ComputeBounds(const std::vector<Vertex> &vertices);
+// bounds of the transformed box (Arvo's method), may be larger than the transformed geometry
+AABB TransformAABB(const AABB &box, const glm::mat4 &transform);
+
+// inside out box, growing it by anything gives that thing's bounds
+AABB EmptyAABB();
+void GrowAABB(AABB &box, const AABB &other);
+void GrowAABB(AABB &box, const glm::vec3 &point);
+glm::vec3 AABBCenter(const AABB &box);
+float AABBSurfaceArea(const AABB &box);
+// slab test, returns the entry distance or a negative value on a miss. a zero direction component
+// gives an infinite inverse, which the test handles
+float IntersectRayAABB(const AABB &box, const glm::vec3 &origin, const glm::vec3 &inverseDirection, float maxDistance);
+
+// binned surface area heuristic split of a BVH node, shared by the scene and triangle hierarchies
+const int SAH_MAX_BINS = 16;
+struct SAHSplit {
+	int axis;			// -1 when every centroid is in the same spot, there's nothing to split
+	int bin;			// first bin of the right side
+	int bins;
+	float cost;			// surface area times count, summed over both sides
+	AABB centroidBounds;
+
+	// whether an item with this centroid goes to the left child
+	bool IsLeft(const glm::vec3 &center) const
+	{
+		float scale = bins / (centroidBounds.max[axis] - centroidBounds.min[axis]);
+		return std::min(bins - 1, (int)((center[axis] - centroidBounds.min[axis]) * scale)) < bin;
+	}
+};
+
+// evaluates every plane between the filled bins of one axis, keeping it in split when it's cheaper
+void SweepSAHBins(const AABB *binBounds, const unsigned int *binCounts, int axis, SAHSplit &split);
+
+// picks the cheapest of the bins - 1 planes per axis, boxOf(i) returns the box of item i
+template<typename BoxOf>
+SAHSplit FindSAHSplit(unsigned int count, int bins, BoxOf boxOf)
+{
+	SAHSplit split;
+	split.axis = -1;
+	split.bin = 0;
+	split.bins = std::min(bins, SAH_MAX_BINS);
+	split.cost = std::numeric_limits<float>::max();
+	split.centroidBounds = EmptyAABB();
+	for (unsigned int i = 0; i < count; i++)
+	{
+		GrowAABB(split.centroidBounds, AABBCenter(boxOf(i)));
+	}
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		float extent = split.centroidBounds.max[axis] - split.centroidBounds.min[axis];
+		if (extent <= 0.0f)
+		{
+			continue;
+		}
+
+		AABB binBounds[SAH_MAX_BINS];
+		unsigned int binCounts[SAH_MAX_BINS] = {};
+		for (int b = 0; b < split.bins; b++)
+		{
+			binBounds[b] = EmptyAABB();
+		}
+		float scale = split.bins / extent;
+		for (unsigned int i = 0; i < count; i++)
+		{
+			const AABB &box = boxOf(i);
+			int bin = std::min(split.bins - 1, (int)((AABBCenter(box)[axis] - split.centroidBounds.min[axis]) * scale));
+			binCounts[bin]++;
+			GrowAABB(binBounds[bin], box);
+		}
+		SweepSAHBins(binBounds, binCounts, axis, split);
+	}
+	return split;
+}
+
+// planes point inwards: a point p is inside when dot(plane.xyz, p) + plane.w >= 0 for all six
+struct Frustum {
+	glm::vec4 planes[6];
+};
+
+// Gribb/Hartmann plane extraction, pass projection * view for world space planes
+Frustum ExtractFrustum(const glm::mat4 &viewProjection);
+bool IntersectsFrustum(const Frustum &frustum, const AABB &box);
+bool IntersectsFrustum(const Frustum &frustum, const BoundingSphere &sphere);
+
+// boxes in structure of arrays form (center and half extent per axis), padded so the SIMD loops never
+// need a scalar tail
+class BoundsBatch
+{
+public:
+	/* Functions */
+	void Clear();
+	void Reserve(size_t count);
+	void Add(const AABB &box);
+	size_t Size() const { return count; }
+
+	/* Batch Data */
+	std::vector<float> centerX, centerY, centerZ;
+	std::vector<float> extentX, extentY, extentZ;
+
+private:
+	size_t count = 0;
+};
+
+// visible[i] becomes 1 for every box that is at least partially inside the frustum, 0 otherwise.
+// tests 8 boxes at a time with AVX, 4 with SSE, one at a time elsewhere
+void CullBatch(const Frustum &frustum, const BoundsBatch &batch, std::vector<unsigned char> &visible);
+
+// culls 100k random boxes against the frustum a few times and prints the timings
+void RunCullingBenchmark(const Frustum &frustum);
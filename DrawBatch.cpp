@@ -0,0 +1,100 @@
+#include "DrawBatch.h"
+#include "GLState.h"
+
+void DrawBatch::Build(const std::vector<Mesh> &meshes)
+{
+	buckets.clear();
+	for (unsigned int i = 0; i < meshes.size(); i++)
+	{
+		// only runs of neighbours are merged, so the draws keep the per mesh order and fragments of equal
+		// depth from different meshes resolve the same way under GL_LESS
+		const Mesh &mesh = meshes[i];
+		Bucket *bucket = nullptr;
+		if (!buckets.empty() && meshes[buckets.back().mesh].CanBatchWith(mesh))
+		{
+			bucket = &buckets.back();
+		}
+		if (!bucket)
+		{
+			buckets.emplace_back();
+			bucket = &buckets.back();
+			bucket->mesh = i;
+			bucket->VAO = mesh.VAO;
+			bucket->indexType = mesh.indexType;
+		}
+
+		bucket->counts.push_back((GLsizei)mesh.indexCount);
+		bucket->offsets.push_back((const void*)mesh.indexOffset);
+		bucket->baseVertices.push_back(mesh.baseVertex);
+	}
+
+#ifdef GL_VERSION_4_3
+	if (GLAD_GL_VERSION_4_3)
+	{
+		// the commands are static, so they're written once into an immutable buffer
+		std::vector<DrawElementsIndirectCommand> commands;
+		for (Bucket &bucket : buckets)
+		{
+			size_t indexSize = bucket.indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+			bucket.firstCommand = commands.size();
+			for (size_t i = 0; i < bucket.counts.size(); i++)
+			{
+				DrawElementsIndirectCommand command;
+				command.count = (GLuint)bucket.counts[i];
+				command.instanceCount = 1;
+				command.firstIndex = (GLuint)((size_t)bucket.offsets[i] / indexSize);
+				command.baseVertex = bucket.baseVertices[i];
+				command.baseInstance = 0;
+				commands.push_back(command);
+			}
+		}
+
+		if (!commands.empty())
+		{
+			glGenBuffers(1, &indirectBuffer);
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+			glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_STATIC_DRAW);
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		}
+	}
+#endif
+}
+
+void DrawBatch::Draw(std::vector<Mesh> &meshes, const Shader &shader)
+{
+#ifdef GL_VERSION_4_3
+	if (indirectBuffer)
+	{
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+	}
+#endif
+
+	GLState &state = GLState::Shared();
+	for (const Bucket &bucket : buckets)
+	{
+		meshes[bucket.mesh].BindMaterial(shader);
+		state.BindVertexArray(bucket.VAO);
+
+#ifdef GL_VERSION_4_3
+		if (indirectBuffer)
+		{
+			const void *commandOffset = (const void*)(bucket.firstCommand * sizeof(DrawElementsIndirectCommand));
+			glMultiDrawElementsIndirect(GL_TRIANGLES, bucket.indexType, commandOffset, (GLsizei)bucket.counts.size(), 0);
+			continue;
+		}
+#endif
+		glMultiDrawElementsBaseVertex(GL_TRIANGLES, bucket.counts.data(), bucket.indexType,
+			const_cast<const void**>(bucket.offsets.data()), (GLsizei)bucket.counts.size(),
+			bucket.baseVertices.data());
+	}
+
+#ifdef GL_VERSION_4_3
+	if (indirectBuffer)
+	{
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	}
+#endif
+
+	// always good practice to set everything back to default once configured;
+	state.ActiveTexture(GL_TEXTURE0);
+}
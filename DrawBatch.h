@@ -0,0 +1,49 @@
+#pragma once
+#include <glad/glad.h>
+
+#include "Shader.h"
+#include "Mesh.h"
+
+#include <vector>
+
+// layout glMultiDrawElementsIndirect reads from the GL_DRAW_INDIRECT_BUFFER
+struct DrawElementsIndirectCommand {
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;		// in indices, not bytes
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+// Groups runs of neighbouring meshes of a model that share buffers, index type and material into buckets, so
+// every bucket is drawn with a single multi-draw call. Uses glMultiDrawElementsIndirect on GL 4.3 and falls
+// back to glMultiDrawElementsBaseVertex on GL 3.3. The meshes are drawn in the same order as per mesh drawing,
+// so Model sorts them by material on upload to make the runs long.
+class DrawBatch
+{
+public:
+	/* Functions */
+	// buckets never change after this, call on the GL thread once the meshes are uploaded
+	void Build(const std::vector<Mesh> &meshes);
+	void Draw(std::vector<Mesh> &meshes, const Shader &shader);
+
+	size_t BucketCount() const { return buckets.size(); }
+	bool UsesIndirect() const { return indirectBuffer != 0; }
+
+private:
+	/* Batch Data */
+	struct Bucket {
+		// the mesh whose material and vertex decoding is bound for the whole bucket
+		unsigned int mesh;
+		unsigned int VAO;
+		GLenum indexType;
+		// fallback arguments, one entry per mesh
+		std::vector<GLsizei> counts;
+		std::vector<const void*> offsets;
+		std::vector<GLint> baseVertices;
+		// range in the indirect buffer
+		size_t firstCommand;
+	};
+	std::vector<Bucket> buckets;
+	unsigned int indirectBuffer = 0;
+};
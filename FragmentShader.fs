@@ -23,10 +23,16 @@ in vec3 FragPos;
 uniform Material material;
 uniform Light light;
 
+layout (std140) uniform Camera
+{
+	mat4 view;
+	mat4 projection;
+	vec4 viewPos;
+};
+
 uniform vec3 objectColor;
 uniform vec3 lightColor;
 uniform vec3 lightPos;
-uniform vec3 viewPos;
 
 void main()
 {
@@ -42,7 +48,7 @@ void main()
 
 	// specular
 	//float specularStrength = 0.5;
-	vec3 viewDir = normalize(viewPos - FragPos);
+	vec3 viewDir = normalize(viewPos.xyz - FragPos);
 	vec3 reflectDir = reflect(-lightDir, norm);
 
 	float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess); // power of 2
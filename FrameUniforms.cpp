@@ -0,0 +1,140 @@
+#include "FrameUniforms.h"
+
+#include <cstring>
+
+static GLsizeiptr alignUp(GLsizeiptr value, GLsizeiptr alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+FrameUniforms::FrameUniforms()
+	: UBO(0), persistentData(nullptr), frame(0)
+{
+	for (unsigned int i = 0; i < FRAME_COUNT; i++)
+	{
+		fences[i] = 0;
+	}
+
+	// glBindBufferRange offsets have to respect the implementation's alignment
+	GLint offsetAlignment = 256;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &offsetAlignment);
+	cameraOffset = 0;
+	lightsOffset = alignUp(sizeof(CameraBlock), offsetAlignment);
+	frameStride = alignUp(lightsOffset + sizeof(LightsBlock), offsetAlignment);
+
+	glGenBuffers(1, &UBO);
+	glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+
+#ifdef GL_VERSION_4_4
+	if (GLAD_GL_VERSION_4_4)
+	{
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_UNIFORM_BUFFER, frameStride * FRAME_COUNT, NULL, flags);
+		persistentData = static_cast<unsigned char*>(glMapBufferRange(GL_UNIFORM_BUFFER, 0, frameStride * FRAME_COUNT, flags));
+	}
+#endif
+	if (!persistentData)
+	{
+		glBufferData(GL_UNIFORM_BUFFER, frameStride * FRAME_COUNT, NULL, GL_STREAM_DRAW);
+	}
+
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void FrameUniforms::Attach(const Shader &shader) const
+{
+	GLuint cameraIndex = glGetUniformBlockIndex(shader.ID, "Camera");
+	if (cameraIndex != GL_INVALID_INDEX)
+	{
+		glUniformBlockBinding(shader.ID, cameraIndex, CAMERA_BLOCK_BINDING);
+	}
+
+	GLuint lightsIndex = glGetUniformBlockIndex(shader.ID, "Lights");
+	if (lightsIndex != GL_INVALID_INDEX)
+	{
+		glUniformBlockBinding(shader.ID, lightsIndex, LIGHTS_BLOCK_BINDING);
+	}
+}
+
+void FrameUniforms::Update(const CameraBlock &camera, const LightsBlock &lights)
+{
+	// the GPU may still be reading this region from FRAME_COUNT frames ago
+	waitForFrame(frame);
+
+	GLintptr frameOffset = frameStride * frame;
+	if (persistentData)
+	{
+		std::memcpy(persistentData + frameOffset + cameraOffset, &camera, sizeof(CameraBlock));
+		std::memcpy(persistentData + frameOffset + lightsOffset, &lights, sizeof(LightsBlock));
+	}
+	else
+	{
+		// the fence already guarantees the region is free, so skip the driver's own synchronization
+		glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+		const GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+		unsigned char *data = static_cast<unsigned char*>(glMapBufferRange(GL_UNIFORM_BUFFER, frameOffset, frameStride, access));
+		if (data)
+		{
+			std::memcpy(data + cameraOffset, &camera, sizeof(CameraBlock));
+			std::memcpy(data + lightsOffset, &lights, sizeof(LightsBlock));
+			glUnmapBuffer(GL_UNIFORM_BUFFER);
+		}
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+
+	glBindBufferRange(GL_UNIFORM_BUFFER, CAMERA_BLOCK_BINDING, UBO, frameOffset + cameraOffset, sizeof(CameraBlock));
+	glBindBufferRange(GL_UNIFORM_BUFFER, LIGHTS_BLOCK_BINDING, UBO, frameOffset + lightsOffset, sizeof(LightsBlock));
+}
+
+void FrameUniforms::EndFrame()
+{
+	if (fences[frame])
+	{
+		glDeleteSync(fences[frame]);
+	}
+	fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	frame = (frame + 1) % FRAME_COUNT;
+}
+
+void FrameUniforms::Release()
+{
+	for (unsigned int i = 0; i < FRAME_COUNT; i++)
+	{
+		if (fences[i])
+		{
+			glDeleteSync(fences[i]);
+			fences[i] = 0;
+		}
+	}
+
+	if (persistentData)
+	{
+		glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+		glUnmapBuffer(GL_UNIFORM_BUFFER);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		persistentData = nullptr;
+	}
+	glDeleteBuffers(1, &UBO);
+	UBO = 0;
+}
+
+void FrameUniforms::waitForFrame(unsigned int index)
+{
+	if (!fences[index])
+	{
+		return;
+	}
+
+	GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+	for (;;)
+	{
+		GLenum result = glClientWaitSync(fences[index], flags, 1000000); // 1ms
+		if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED || result == GL_WAIT_FAILED)
+		{
+			break;
+		}
+		flags = 0;
+	}
+	glDeleteSync(fences[index]);
+	fences[index] = 0;
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "Shader.h"
+
+// Per frame data shared by every program through std140 uniform blocks.
+// The C++ structs below mirror the GLSL blocks byte for byte, vec3s are padded to 16 bytes.
+
+const GLuint CAMERA_BLOCK_BINDING = 0;
+const GLuint LIGHTS_BLOCK_BINDING = 1;
+const unsigned int NR_POINT_LIGHTS = 4;
+
+// layout (std140) uniform Camera
+struct CameraBlock {
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::vec4 viewPos;
+};
+
+struct DirLightBlock {
+	glm::vec3 direction;
+	float pad0;
+	glm::vec3 ambient;
+	float pad1;
+	glm::vec3 diffuse;
+	float pad2;
+	glm::vec3 specular;
+	float pad3;
+};
+
+struct PointLightBlock {
+	glm::vec3 position;
+	float constant;
+	glm::vec3 ambient;
+	float linear;
+	glm::vec3 diffuse;
+	float quadratic;
+	glm::vec3 specular;
+	float pad0;
+};
+
+struct SpotLightBlock {
+	glm::vec3 position;
+	float cutOff;
+	glm::vec3 direction;
+	float outerCutOff;
+	glm::vec3 ambient;
+	float constant;
+	glm::vec3 diffuse;
+	float linear;
+	glm::vec3 specular;
+	float quadratic;
+};
+
+// layout (std140) uniform Lights
+struct LightsBlock {
+	DirLightBlock dirLight;
+	PointLightBlock pointLights[NR_POINT_LIGHTS];
+	SpotLightBlock spotLight;
+	GLint useSpotLight;
+	GLint pad0[3];
+};
+
+static_assert(sizeof(CameraBlock) == 144, "CameraBlock must match the std140 Camera block");
+static_assert(sizeof(PointLightBlock) == 64, "PointLightBlock must match the std140 array stride");
+static_assert(sizeof(LightsBlock) == 416, "LightsBlock must match the std140 Lights block");
+
+// Triple buffered ring holding the camera and lights blocks. Each frame writes both blocks
+// with one buffer update into the region the GPU finished with, guarded by a fence.
+// The ring is persistently mapped when the context supports GL 4.4, otherwise every
+// update maps its region unsynchronized.
+class FrameUniforms
+{
+public:
+	static const unsigned int FRAME_COUNT = 3;
+
+	/* Functions */
+	// needs a current GL context
+	FrameUniforms();
+
+	// bind the Camera and Lights blocks of a program (if it uses them) to our binding points
+	void Attach(const Shader &shader) const;
+
+	// write this frame's blocks and bind their ranges
+	void Update(const CameraBlock &camera, const LightsBlock &lights);
+	// fence the region used this frame and move on to the next one
+	void EndFrame();
+
+	// delete the GL objects, call before the context goes away
+	void Release();
+
+private:
+	/* Render Data */
+	unsigned int UBO;
+	GLsync fences[FRAME_COUNT];
+	unsigned char *persistentData;
+
+	unsigned int frame;
+	GLsizeiptr cameraOffset;
+	GLsizeiptr lightsOffset;
+	GLsizeiptr frameStride;
+
+	/* Functions */
+	void waitForFrame(unsigned int index);
+};
@@ -0,0 +1,169 @@
+#include "GLState.h"
+
+static const GLenum TRACKED_CAPABILITIES[] = { GL_DEPTH_TEST, GL_BLEND, GL_CULL_FACE, GL_STENCIL_TEST, GL_SCISSOR_TEST };
+
+GLState &GLState::Shared()
+{
+	static GLState state;
+	return state;
+}
+
+GLState::GLState()
+{
+	static_assert(sizeof(TRACKED_CAPABILITIES) / sizeof(TRACKED_CAPABILITIES[0]) == CAPABILITY_COUNT,
+		"CAPABILITY_COUNT must match TRACKED_CAPABILITIES");
+	Invalidate();
+}
+
+void GLState::Invalidate()
+{
+	program = UNKNOWN;
+	vertexArray = UNKNOWN;
+	activeUnit = UNKNOWN;
+	for (unsigned int i = 0; i < MAX_TEXTURE_UNITS; i++)
+	{
+		textures2D[i] = UNKNOWN;
+	}
+	for (unsigned int i = 0; i < CAPABILITY_COUNT; i++)
+	{
+		capabilities[i] = UNKNOWN;
+	}
+	depthFunc = UNKNOWN;
+}
+
+void GLState::ForgetTexture(GLuint texture)
+{
+	for (unsigned int i = 0; i < MAX_TEXTURE_UNITS; i++)
+	{
+		if (textures2D[i] == texture)
+		{
+			textures2D[i] = UNKNOWN;
+		}
+	}
+}
+
+void GLState::UseProgram(GLuint program)
+{
+	if (this->program == program)
+	{
+		frame.filtered++;
+		return;
+	}
+	this->program = program;
+	glUseProgram(program);
+	frame.issued++;
+}
+
+void GLState::BindVertexArray(GLuint vertexArray)
+{
+	if (this->vertexArray == vertexArray)
+	{
+		frame.filtered++;
+		return;
+	}
+	this->vertexArray = vertexArray;
+	glBindVertexArray(vertexArray);
+	frame.issued++;
+}
+
+void GLState::ActiveTexture(GLenum unit)
+{
+	if (activeUnit == unit)
+	{
+		frame.filtered++;
+		return;
+	}
+	activeUnit = unit;
+	glActiveTexture(unit);
+	frame.issued++;
+}
+
+void GLState::BindTexture(GLenum target, GLuint texture)
+{
+	unsigned int unit = activeUnit - GL_TEXTURE0;
+	if (target != GL_TEXTURE_2D || activeUnit == UNKNOWN || unit >= MAX_TEXTURE_UNITS)
+	{
+		// untracked, pass it through
+		glBindTexture(target, texture);
+		frame.issued++;
+		return;
+	}
+
+	if (textures2D[unit] == texture)
+	{
+		frame.filtered++;
+		return;
+	}
+	textures2D[unit] = texture;
+	glBindTexture(target, texture);
+	frame.issued++;
+}
+
+void GLState::BindTextureUnit(unsigned int unit, GLenum target, GLuint texture)
+{
+	if (target == GL_TEXTURE_2D && unit < MAX_TEXTURE_UNITS && textures2D[unit] == texture)
+	{
+		// already bound, don't even switch the active unit
+		frame.filtered++;
+		return;
+	}
+	ActiveTexture(GL_TEXTURE0 + unit);
+	BindTexture(target, texture);
+}
+
+void GLState::Enable(GLenum capability)
+{
+	setCapability(capability, true);
+}
+
+void GLState::Disable(GLenum capability)
+{
+	setCapability(capability, false);
+}
+
+void GLState::setCapability(GLenum capability, bool enabled)
+{
+	for (unsigned int i = 0; i < CAPABILITY_COUNT; i++)
+	{
+		if (TRACKED_CAPABILITIES[i] != capability)
+		{
+			continue;
+		}
+		GLuint value = enabled ? GL_TRUE : GL_FALSE;
+		if (capabilities[i] == value)
+		{
+			frame.filtered++;
+			return;
+		}
+		capabilities[i] = value;
+		break;
+	}
+
+	if (enabled)
+	{
+		glEnable(capability);
+	}
+	else
+	{
+		glDisable(capability);
+	}
+	frame.issued++;
+}
+
+void GLState::DepthFunc(GLenum func)
+{
+	if (depthFunc == func)
+	{
+		frame.filtered++;
+		return;
+	}
+	depthFunc = func;
+	glDepthFunc(func);
+	frame.issued++;
+}
+
+void GLState::EndFrame()
+{
+	lastFrame = frame;
+	frame = Counters();
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <glad/glad.h>
+
+// Shadow copy of the GL state the renderer changes most: program, VAO, texture units and a few
+// capabilities. Calls that wouldn't change anything are dropped, and the counters show how many were.
+// Only use it on the GL thread, and call Invalidate() after code that changes this state behind its back.
+class GLState
+{
+public:
+	/* Functions */
+	static GLState &Shared();
+
+	void UseProgram(GLuint program);
+	void BindVertexArray(GLuint vertexArray);
+	void ActiveTexture(GLenum unit);
+	// binds to the active texture unit
+	void BindTexture(GLenum target, GLuint texture);
+	// binds to a specific unit, only switching the active unit when the binding actually changes
+	void BindTextureUnit(unsigned int unit, GLenum target, GLuint texture);
+	void Enable(GLenum capability);
+	void Disable(GLenum capability);
+	void DepthFunc(GLenum func);
+
+	// forget everything, the next call of each kind always reaches GL
+	void Invalidate();
+	// call before deleting a texture, GL may hand its name out again to a texture that isn't bound anywhere
+	void ForgetTexture(GLuint texture);
+
+	struct Counters {
+		unsigned int issued;	// calls that reached GL
+		unsigned int filtered;	// redundant calls that were skipped
+	};
+	const Counters &Frame() const { return frame; }
+	const Counters &LastFrame() const { return lastFrame; }
+	// stores the current counters as the last frame's and starts counting again
+	void EndFrame();
+
+private:
+	/* State Data */
+	static const unsigned int MAX_TEXTURE_UNITS = 32;
+	static const unsigned int CAPABILITY_COUNT = 5;
+	static const GLuint UNKNOWN = 0xffffffffu;
+
+	GLuint program;
+	GLuint vertexArray;
+	GLenum activeUnit;
+	GLuint textures2D[MAX_TEXTURE_UNITS];
+	// UNKNOWN, GL_FALSE or GL_TRUE per tracked capability
+	GLuint capabilities[CAPABILITY_COUNT];
+	GLenum depthFunc;
+
+	Counters frame = {};
+	Counters lastFrame = {};
+
+	/* Functions */
+	GLState();
+	void setCapability(GLenum capability, bool enabled);
+};
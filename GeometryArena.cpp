@@ -0,0 +1,72 @@
+#include "GeometryArena.h"
+#include "Mesh.h"
+#include "GLState.h"
+
+#include <cstring>
+
+GeometryArena::GeometryArena(VertexFormat format)
+	: VBO(0), EBO(0), format(format),
+	stride(format == VERTEX_FORMAT_PACKED ? sizeof(PackedVertex) : sizeof(Vertex)),
+	vertexCount(0), vertexBytes(0), indexBytes(0)
+{
+	glGenVertexArrays(1, &VAO);
+}
+
+GeometryRange GeometryArena::Add(const void *vertexData, size_t count, const std::vector<unsigned int> &indices)
+{
+	GeometryRange range;
+	range.baseVertex = (GLint)vertexCount;
+	range.indexCount = (unsigned int)indices.size();
+	range.indexOffset = indexStaging.size();
+
+	size_t vertexOffset = vertexStaging.size();
+	vertexStaging.resize(vertexOffset + count * stride);
+	std::memcpy(vertexStaging.data() + vertexOffset, vertexData, count * stride);
+	vertexCount += count;
+
+	// indices are relative to baseVertex, so the vertex count of this mesh alone decides the index size
+	range.indexType = count < MAX_SHORT_INDEX_VERTICES ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	AddIndices(indices, range.indexType);
+	return range;
+}
+
+size_t GeometryArena::AddIndices(const std::vector<unsigned int> &indices, GLenum indexType)
+{
+	size_t offset = indexStaging.size();
+	if (indexType == GL_UNSIGNED_SHORT)
+	{
+		indexStaging.resize(offset + indices.size() * sizeof(unsigned short));
+		unsigned short *out = reinterpret_cast<unsigned short*>(indexStaging.data() + offset);
+		for (size_t i = 0; i < indices.size(); i++)
+		{
+			out[i] = (unsigned short)indices[i];
+		}
+		// keep the next range 4 byte aligned, in case it holds 32 bit indices
+		indexStaging.resize((indexStaging.size() + 3) & ~(size_t)3);
+	}
+	else
+	{
+		indexStaging.resize(offset + indices.size() * sizeof(unsigned int));
+		std::memcpy(indexStaging.data() + offset, indices.data(), indices.size() * sizeof(unsigned int));
+	}
+	return offset;
+}
+
+void GeometryArena::Upload()
+{
+	glGenBuffers(1, &VBO);
+	glGenBuffers(1, &EBO);
+
+	GLState::Shared().BindVertexArray(VAO);
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glBufferData(GL_ARRAY_BUFFER, vertexStaging.size(), vertexStaging.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexStaging.size(), indexStaging.data(), GL_STATIC_DRAW);
+	SetupVertexAttributes(format);
+	GLState::Shared().BindVertexArray(0);
+
+	vertexBytes = vertexStaging.size();
+	indexBytes = indexStaging.size();
+	std::vector<unsigned char>().swap(vertexStaging);
+	std::vector<unsigned char>().swap(indexStaging);
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <glad/glad.h>
+
+#include "Vertex.h"
+
+#include <vector>
+
+// where a mesh lives inside an arena, drawn with glDrawElementsBaseVertex
+struct GeometryRange {
+	size_t indexOffset;		// in bytes, always 4 byte aligned
+	unsigned int indexCount;
+	GLint baseVertex;
+	GLenum indexType;
+};
+
+// One VAO, VBO and EBO shared by many meshes of the same vertex format.
+// Meshes are appended to CPU staging memory first and the buffers are created in one go by Upload(),
+// after which drawing a whole model only needs a single VAO bind. 16 and 32 bit index ranges can be mixed.
+class GeometryArena
+{
+public:
+	/* Arena Data */
+	unsigned int VAO;
+
+	/* Functions */
+	// creates the VAO right away so meshes can reference it before Upload(), call on the GL thread
+	explicit GeometryArena(VertexFormat format);
+
+	// copies vertexCount vertices (Vertex or PackedVertex, matching the format) and their indices into staging
+	GeometryRange Add(const void *vertexData, size_t vertexCount, const std::vector<unsigned int> &indices);
+	// more indices for vertices added before (e.g. a level of detail), returns their byte offset
+	size_t AddIndices(const std::vector<unsigned int> &indices, GLenum indexType);
+
+	// creates the buffers from staging and releases the staging memory
+	void Upload();
+
+	VertexFormat Format() const { return format; }
+	size_t VertexCount() const { return vertexCount; }
+	size_t VertexBytes() const { return vertexBytes; }
+	size_t IndexBytes() const { return indexBytes; }
+
+private:
+	/* Render Data */
+	unsigned int VBO, EBO;
+	VertexFormat format;
+	size_t stride;
+	size_t vertexCount;
+	size_t vertexBytes;
+	size_t indexBytes;
+	std::vector<unsigned char> vertexStaging;
+	std::vector<unsigned char> indexStaging;
+};
@@ -0,0 +1,61 @@
+#include "InstanceBuffer.h"
+#include "GLState.h"
+
+#include <algorithm>
+#include <cstddef>
+
+void InstanceBuffer::Upload(const glm::mat4 *matrices, const glm::vec4 *colors, size_t count)
+{
+	staging.resize(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		staging[i].model = matrices[i];
+		staging[i].color = colors ? colors[i] : glm::vec4(1.0f);
+	}
+
+	if (!VBO)
+	{
+		glGenBuffers(1, &VBO);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+
+	// grow in powers of two so a slowly changing instance count doesn't reallocate every frame
+	size_t size = count * sizeof(InstanceData);
+	if (size > capacity)
+	{
+		capacity = std::max(capacity, (size_t)64 * sizeof(InstanceData));
+		while (capacity < size)
+		{
+			capacity *= 2;
+		}
+	}
+
+	// orphan the old storage, then fill the new one
+	glBufferData(GL_ARRAY_BUFFER, capacity, NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, size, staging.data());
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void InstanceBuffer::Attach(unsigned int VAO)
+{
+	if (std::find(attachedVAOs.begin(), attachedVAOs.end(), VAO) != attachedVAOs.end())
+	{
+		return;
+	}
+	attachedVAOs.push_back(VAO);
+
+	GLState::Shared().BindVertexArray(VAO);
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	// a mat4 attribute is four vec4 columns, each advancing once per instance
+	for (unsigned int column = 0; column < 4; column++)
+	{
+		glEnableVertexAttribArray(INSTANCE_MATRIX_LOCATION + column);
+		glVertexAttribPointer(INSTANCE_MATRIX_LOCATION + column, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+			(void*)(offsetof(InstanceData, model) + column * sizeof(glm::vec4)));
+		glVertexAttribDivisor(INSTANCE_MATRIX_LOCATION + column, 1);
+	}
+	glEnableVertexAttribArray(INSTANCE_COLOR_LOCATION);
+	glVertexAttribPointer(INSTANCE_COLOR_LOCATION, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)offsetof(InstanceData, color));
+	glVertexAttribDivisor(INSTANCE_COLOR_LOCATION, 1);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
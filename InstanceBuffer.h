@@ -0,0 +1,37 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// first of the four attribute locations a per-instance model matrix occupies (one vec4 column each)
+const unsigned int INSTANCE_MATRIX_LOCATION = 5;
+// per-instance color, right after the matrix
+const unsigned int INSTANCE_COLOR_LOCATION = 9;
+
+// one instance as laid out in the buffer
+struct InstanceData {
+	glm::mat4 model;
+	glm::vec4 color;
+};
+
+// Per-instance model matrices, streamed every draw. The buffer is orphaned before each upload so the driver
+// can hand out fresh storage instead of waiting for draws that still read the previous matrices.
+class InstanceBuffer
+{
+public:
+	/* Functions */
+	// replaces the contents with count instances, call on the GL thread. colors can be null, instances are white then
+	void Upload(const glm::mat4 *matrices, const glm::vec4 *colors, size_t count);
+
+	// points the instance attributes of a VAO at this buffer, only does work the first time per VAO
+	void Attach(unsigned int VAO);
+
+private:
+	/* Render Data */
+	unsigned int VBO = 0;
+	size_t capacity = 0;
+	// interleaved copy of the last upload, reused so a steady instance count doesn't allocate
+	std::vector<InstanceData> staging;
+	std::vector<unsigned int> attachedVAOs;
+};
@@ -3,10 +3,31 @@ layout (location = 0) in vec3 aPos;
 
 // uniform mat4 transform;
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+
+// set while a model is drawn instanced, the model matrix and the color then come from the instance attributes
+uniform bool instanced;
+layout (location = 5) in mat4 aInstanceModel;
+layout (location = 9) in vec4 aInstanceColor;
+uniform vec3 color;
+
+flat out vec3 LampColor;
+
+// packed meshes store snorm16 positions relative to their bounds
+uniform bool packedVertex;
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
+layout (std140) uniform Camera
+{
+	mat4 view;
+	mat4 projection;
+	vec4 viewPos;
+};
 
 void main()
 {
-	gl_Position = projection * view * model * vec4(aPos, 1.0);
+	mat4 world = instanced ? aInstanceModel : model;
+	LampColor = instanced ? aInstanceColor.rgb : color;
+	vec3 position = packedVertex ? positionOffset + aPos * positionScale : aPos;
+	gl_Position = projection * view * world * vec4(position, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,61 @@
+#include "Lod.h"
+
+#include <algorithm>
+#include <cmath>
+
+void LodSelector::SetView(const Camera &camera, float viewportHeight)
+{
+	viewPosition = camera.Position;
+	// same field of view as the projection in Main, zooming in makes every error bigger on screen
+	projectionScale = viewportHeight / (2.0f * std::tan(glm::radians(camera.Zoom) * 0.5f));
+}
+
+float LodSelector::projectedError(const Mesh &mesh, unsigned int lod, float scale, float distance) const
+{
+	return mesh.lods[lod].error * scale / distance * projectionScale;
+}
+
+unsigned int LodSelector::Select(const Mesh &mesh, const glm::mat4 &transform, const AABB &worldBounds, unsigned int current) const
+{
+	unsigned int levels = mesh.LodCount();
+	if (levels <= 1)
+	{
+		return 0;
+	}
+	current = std::min(current, levels - 1);
+
+	// errors are in object space, the largest axis scale is a safe bound for the world space error
+	float scale = std::max(glm::length(glm::vec3(transform[0])), std::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+
+	// nearest point of the bounds, inside them everything is drawn at full detail
+	glm::vec3 nearest = glm::max(worldBounds.min, glm::min(viewPosition, worldBounds.max));
+	float distance = glm::length(nearest - viewPosition);
+	if (distance <= 0.0f)
+	{
+		return 0;
+	}
+
+	// going coarser needs the error comfortably below the threshold
+	float coarserThreshold = pixelError * (1.0f - hysteresis);
+	unsigned int coarser = current;
+	while (coarser + 1 < levels && projectedError(mesh, coarser + 1, scale, distance) <= coarserThreshold)
+	{
+		coarser++;
+	}
+	if (coarser != current)
+	{
+		return coarser;
+	}
+
+	// going finer only once the current level is clearly too coarse
+	if (projectedError(mesh, current, scale, distance) > pixelError * (1.0f + hysteresis))
+	{
+		unsigned int finer = current;
+		while (finer > 0 && projectedError(mesh, finer, scale, distance) > pixelError)
+		{
+			finer--;
+		}
+		return finer;
+	}
+	return current;
+}
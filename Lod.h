@@ -0,0 +1,32 @@
+#pragma once
+#include <glm/glm.hpp>
+
+#include "Camera.h"
+#include "Mesh.h"
+#include "Culling.h"
+
+// Picks a level of detail per instance from how many pixels its simplification error covers on screen,
+// which depends on the distance to the camera and its zoom. Levels only change once the error is clearly
+// past the threshold, so an instance sitting right at a switching distance doesn't flicker between two.
+class LodSelector
+{
+public:
+	/* Selection Settings */
+	float pixelError = 1.0f;	// coarsest level whose error projects to at most this many pixels
+	float hysteresis = 0.25f;	// fraction of pixelError a level has to move past before switching
+
+	/* Functions */
+	// call once per frame before Select
+	void SetView(const Camera &camera, float viewportHeight);
+	// returns the level to draw given the one drawn last frame
+	unsigned int Select(const Mesh &mesh, const glm::mat4 &transform, const AABB &worldBounds, unsigned int current) const;
+
+private:
+	/* View Data */
+	glm::vec3 viewPosition;
+	// pixels covered by one unit at distance one
+	float projectionScale = 1.0f;
+
+	/* Functions */
+	float projectedError(const Mesh &mesh, unsigned int lod, float scale, float distance) const;
+};
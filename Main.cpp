@@ -9,7 +9,16 @@
 #include "Shader.h"
 #include "Camera.h"
 #include "Model.h"
-
+#include "FrameUniforms.h"
+#include "Picking.h"
+#include "Occlusion.h"
+#include "TextureStreamer.h"
+#include "BakedTexture.h"
+#include "ProcessMemory.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 
 struct OldMaterial {
@@ -76,14 +85,13 @@ struct Transform {
 	glm::vec3 scale;
 };
 
-unsigned int LoadTexture(const char *path);
-
 // callbacks
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void processInput(GLFWwindow *window);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void keyboard_callback(GLFWwindow *window, int key, int scancode, int action, int mods);
+bool compareBatching(const char *name, Model &model, const Shader &shader, FrameUniforms &frameUniforms, const LightsBlock &lightsBlock);
 
 // settings
 const unsigned int SCR_WIDTH = 1920/2;//800*2;
@@ -112,6 +120,12 @@ float aspectRatio = (float)SCR_WIDTH / (float)SCR_HEIGHT;
 float nearPlane{ 0.1f };
 float farPlane{ 100.0f };
 
+// picking, the triangle under the cursor is refreshed every frame
+Picker picker;
+PickHit hoveredPick;
+bool hovering{ false };
+double pickTime{}; // seconds the last pick took
+
 
 Light light;
 DirectionalLight directionalLight;
@@ -184,8 +198,45 @@ float planeVertices[] = {
 	 5.0f, -0.5f, -5.0f,  2.0f, 2.0f
 };
 
-int main()
+int main(int argc, char **argv)
 {
+	// --bake-textures [--box] [--fast | --high | --uncompressed]: bake every texture with its mip chain
+	// (block compressed unless asked not to) and exit, no window needed
+	if (argc > 1 && std::strcmp(argv[1], "--bake-textures") == 0)
+	{
+		TextureBakeOptions bakeOptions;
+		for (int i = 2; i < argc; i++)
+		{
+			if (std::strcmp(argv[i], "--box") == 0)
+			{
+				bakeOptions.filter = MIP_FILTER_BOX;
+			}
+			else if (std::strcmp(argv[i], "--fast") == 0)
+			{
+				bakeOptions.quality = COMPRESSION_FAST;
+			}
+			else if (std::strcmp(argv[i], "--high") == 0)
+			{
+				bakeOptions.quality = COMPRESSION_HIGH;
+			}
+			else if (std::strcmp(argv[i], "--uncompressed") == 0)
+			{
+				bakeOptions.compress = false;
+			}
+		}
+		return BakedTexture::BakeDirectories({ "Assets/Textures", "Assets/Models" }, bakeOptions) == 0 ? 0 : 1;
+	}
+	// --cull-benchmark: run the B key's culling benchmark from the starting camera and exit, no window needed
+	if (argc > 1 && std::strcmp(argv[1], "--cull-benchmark") == 0)
+	{
+		glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+		RunCullingBenchmark(ExtractFrustum(projection * camera.GetViewMatrix()));
+		return 0;
+	}
+	// --compare-batching: render every model per mesh and batched into offscreen targets, compare the
+	// pixels and exit, 1 when they differ. the window stays hidden, so it also runs on Mesa llvmpipe
+	bool batchingComparison = argc > 1 && std::strcmp(argv[1], "--compare-batching") == 0;
+
 	camera.MovementSpeed = moveSpeed;
 	light.position = glm::vec3(1.2f, 1.0f, 2.0f);
 	light.ambient = glm::vec3(1.0f, 1.0f, 1.0f);
@@ -262,6 +313,10 @@ int main()
 #ifdef __APPLE__
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); // uncomment this statement to fix compilation on OS X
 #endif
+	if (batchingComparison)
+	{
+		glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+	}
 
 	// glfw window creation
 	// --------------------
@@ -287,10 +342,17 @@ int main()
 		return -1;
 	}
 
-	// configure global opengl state
+	// textures without a bake get one while they load, in a format this context can sample
+	DetectBlockFormatSupport();
+	TextureBakeOptions importBake;
+	importBake.supportedFormatsOnly = true;
+	BakedTexture::EnableBakeOnImport(importBake);
+
+	// configure global opengl state, binds go through the state tracker so redundant ones are skipped
 	// -----------------------------
-	glEnable(GL_DEPTH_TEST);
-	glDepthFunc(GL_LESS); // always pass the depth test (same effect as glDisable(GL_DEPTH_TEST))
+	GLState &glState = GLState::Shared();
+	glState.Enable(GL_DEPTH_TEST);
+	glState.DepthFunc(GL_LESS); // always pass the depth test (same effect as glDisable(GL_DEPTH_TEST))
 
 	
 
@@ -298,32 +360,36 @@ int main()
 	unsigned int cubeVAO, cubeVBO;
 	glGenVertexArrays(1, &cubeVAO);
 	glGenBuffers(1, &cubeVBO);
-	glBindVertexArray(cubeVAO);
+	glState.BindVertexArray(cubeVAO);
 	glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
 	glBufferData(GL_ARRAY_BUFFER, sizeof(cubeVertices), &cubeVertices, GL_STATIC_DRAW);
 	glEnableVertexAttribArray(0);
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
-	glBindVertexArray(0);
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
+	glState.BindVertexArray(0);
 
 	// plane VAO
 	unsigned int planeVAO, planeVBO;
 	glGenVertexArrays(1, &planeVAO);
 	glGenBuffers(1, &planeVBO);
-	glBindVertexArray(planeVAO);
+	glState.BindVertexArray(planeVAO);
 	glBindBuffer(GL_ARRAY_BUFFER, planeVBO);
 	glBufferData(GL_ARRAY_BUFFER, sizeof(planeVertices), &planeVertices, GL_STATIC_DRAW);
 	glEnableVertexAttribArray(0);
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
-	glBindVertexArray(0);
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
+	glState.BindVertexArray(0);
 
 	// load textures
 	// -------------
-	unsigned int cubeTexture = LoadTexture("Assets/Textures/marble.jpg");
-	unsigned int floorTexture = LoadTexture("Assets/Textures/metal.png");
+	// shared with every model through the texture manager, decoded on the thread pool and
+	// uploaded a few per frame by the streamer
+	TextureManager &textureManager = TextureManager::Shared();
+	TextureStreamer &textureStreamer = TextureStreamer::Shared();
+	unsigned int cubeTexture = textureStreamer.Request("Assets/Textures/marble.jpg");
+	unsigned int floorTexture = textureStreamer.Request("Assets/Textures/metal.png");
 
 
 	Shader depthShader("Assets/Shaders/depth_testing.vs", "Assets/Shaders/depth_testing.fs");
@@ -331,15 +397,113 @@ int main()
 	Shader lampShader("LampVertexShader.vs", "LampFragmentShader.fs");
 	Shader testShader("VertexShader.vs", "FragmentShader.fs");
 	
-	Model suzanne("Assets/Models/suzanne/suzanne.obj");
-	Model lowpolycharacter("Assets/Models/low-poly-character/character_low_anim.obj");
-	Model town("Assets/Models/medieval-town-base/sketchfab.obj");
-	Model nanosuit("Assets/Models/nanosuit/nanosuit.obj");
-	Model rotatedBox("Assets/Models/rotated-box/rotated-box.obj");
+	// nothing reads the vertex data back after upload, except the town which keeps its positions.
+	// the town is vertex bound, so it's also uploaded with the packed vertex layout
+	ModelOptions gpuOnly;
+	gpuOnly.residency = MESH_DROP_AFTER_UPLOAD;
+	gpuOnly.optimizeMeshes = true;
+	gpuOnly.streamTextures = true;
+	ModelOptions townOptions;
+	townOptions.residency = MESH_KEEP_POSITIONS;
+	townOptions.vertexFormat = VERTEX_FORMAT_PACKED;
+	townOptions.optimizeMeshes = true;
+	townOptions.optimizeOverdraw = true;
+	townOptions.splitLargeMeshes = true;
+	townOptions.lodLevels = 4;
+	townOptions.streamTextures = true;
+
+	// import all models in parallel, only the GL upload happens on this thread
+	double loadStart = glfwGetTime();
+	ModelLoadHandle suzanneLoad = Model::LoadAsync("Assets/Models/suzanne/suzanne.obj", gpuOnly);
+	ModelLoadHandle lowpolycharacterLoad = Model::LoadAsync("Assets/Models/low-poly-character/character_low_anim.obj", gpuOnly);
+	ModelLoadHandle townLoad = Model::LoadAsync("Assets/Models/medieval-town-base/sketchfab.obj", townOptions);
+	ModelLoadHandle nanosuitLoad = Model::LoadAsync("Assets/Models/nanosuit/nanosuit.obj", gpuOnly);
+	ModelLoadHandle rotatedBoxLoad = Model::LoadAsync("Assets/Models/rotated-box/rotated-box.obj", gpuOnly);
+
+	// load time is measured to the end of each upload, the imports overlap so the numbers include waiting
+	// for the models before it. peak RSS covers importing and uploading everything
+	Model suzanne = suzanneLoad.Get();
+	Model lowpolycharacter = lowpolycharacterLoad.Get();
+	Model town = townLoad.Get();
+	double townLoaded = glfwGetTime();
+	Model nanosuit = nanosuitLoad.Get();
+	double nanosuitLoaded = glfwGetTime();
+	Model rotatedBox = rotatedBoxLoad.Get();
+	double modelsLoaded = glfwGetTime();
+	std::cout << "MODEL_LOAD::town " << (townLoaded - loadStart) * 1000.0 << " ms, nanosuit "
+		<< (nanosuitLoaded - loadStart) * 1000.0 << " ms, all " << (modelsLoaded - loadStart) * 1000.0
+		<< " ms, peak RSS " << PeakResidentBytes() / (1024 * 1024) << " MB" << std::endl;
+	textureManager.PrintStats();
 
 	depthShader.use();
 	depthShader.setInt("texture1", 0);
 
+	// camera and lights are shared by every program through uniform blocks
+	FrameUniforms frameUniforms;
+	frameUniforms.Attach(depthShader);
+	frameUniforms.Attach(shader);
+	frameUniforms.Attach(lampShader);
+	frameUniforms.Attach(testShader);
+
+	LightsBlock lightsBlock = {};
+	lightsBlock.dirLight.direction = directionalLight.direction;
+	lightsBlock.dirLight.ambient = directionalLight.ambient;
+	lightsBlock.dirLight.diffuse = directionalLight.diffuse;
+	lightsBlock.dirLight.specular = directionalLight.specular;
+	for (unsigned int i = 0; i < NR_POINT_LIGHTS; i++) {
+		lightsBlock.pointLights[i].position = pointLights[i].position;
+		lightsBlock.pointLights[i].ambient = pointLights[i].ambient;
+		lightsBlock.pointLights[i].diffuse = pointLights[i].diffuse;
+		lightsBlock.pointLights[i].specular = pointLights[i].specular;
+		lightsBlock.pointLights[i].constant = pointLights[i].constant;
+		lightsBlock.pointLights[i].linear = pointLights[i].linear;
+		lightsBlock.pointLights[i].quadratic = pointLights[i].quadratic;
+	}
+	lightsBlock.spotLight.ambient = spotLight.ambient;
+	lightsBlock.spotLight.diffuse = spotLight.diffuse;
+	lightsBlock.spotLight.specular = spotLight.specular;
+	lightsBlock.spotLight.constant = spotLight.constant;
+	lightsBlock.spotLight.linear = spotLight.linear;
+	lightsBlock.spotLight.quadratic = spotLight.quadratic;
+	lightsBlock.spotLight.cutOff = spotLight.cutOff;
+	lightsBlock.spotLight.outerCutOff = spotLight.outerCutOff;
+	lightsBlock.useSpotLight = true;
+
+	// model matrices of the character grid and the lamps, reused every frame
+	std::vector<glm::mat4> characterInstances;
+	std::vector<glm::mat4> lampInstances;
+	std::vector<glm::vec4> lampColors;
+	RenderQueue renderQueue;
+
+	// static scene geometry, culled hierarchically before it's queued
+	SceneBVH scene;
+	rotatedBox.AddInstances(scene, glm::mat4());
+	town.AddInstances(scene, glm::mat4());
+	scene.Build();
+	picker.Prepare(scene);
+
+	// the biggest simple pieces of the town hide what's behind them
+	OcclusionCuller occlusion;
+	std::vector<unsigned int> occluders = SelectOccluders(scene, 32, 2000);
+
+	// distant town pieces switch to their simplified versions
+	LodSelector lodSelector;
+
+	int exitCode = 0;
+	if (batchingComparison)
+	{
+		// compare with the real textures, not the placeholders
+		textureStreamer.Finish();
+		shader.use();
+		shader.setFloat("material.shininess", 32.0f);
+		bool identical = compareBatching("suzanne", suzanne, shader, frameUniforms, lightsBlock);
+		identical &= compareBatching("lowpolycharacter", lowpolycharacter, shader, frameUniforms, lightsBlock);
+		identical &= compareBatching("town", town, shader, frameUniforms, lightsBlock);
+		identical &= compareBatching("nanosuit", nanosuit, shader, frameUniforms, lightsBlock);
+		identical &= compareBatching("rotatedBox", rotatedBox, shader, frameUniforms, lightsBlock);
+		exitCode = identical ? 0 : 1;
+		glfwSetWindowShouldClose(window, true);
+	}
 
 	// render loop
 	// -----------
@@ -365,16 +529,25 @@ int main()
 		glm::mat4 view = camera.GetViewMatrix();
 		glm::mat4 model = glm::mat4();
 
-		depthShader.use();
-		depthShader.setMat4("view", view);
-		depthShader.setMat4("projection", projection);
+		// one buffer update feeds view/projection and all lights to every program
+		CameraBlock cameraBlock;
+		cameraBlock.view = view;
+		cameraBlock.projection = projection;
+		cameraBlock.viewPos = glm::vec4(camera.Position, 1.0f);
+		lightsBlock.spotLight.position = camera.Position;
+		lightsBlock.spotLight.direction = camera.Front;
+		frameUniforms.Update(cameraBlock, lightsBlock);
 
-		
+		// model draws are queued and executed sorted by state at the end of the frame
+		Frustum frustum = ExtractFrustum(projection * view);
+		renderQueue.Begin(camera.Position, 100.0f);
+
+		depthShader.use();
 
 		// cubes
-		glBindVertexArray(cubeVAO);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, cubeTexture);
+		glState.BindVertexArray(cubeVAO);
+		glState.ActiveTexture(GL_TEXTURE0);
+		glState.BindTexture(GL_TEXTURE_2D, cubeTexture);
 
 		model = glm::mat4();
 		model = glm::translate(model, glm::vec3(-1.0f, 0.0f, -1.0f));
@@ -387,65 +560,41 @@ int main()
 		glDrawArrays(GL_TRIANGLES, 0, 36);
 
 		// floor plane
-		glBindVertexArray(planeVAO);
-		glBindTexture(GL_TEXTURE_2D, floorTexture);
+		glState.BindVertexArray(planeVAO);
+		glState.BindTexture(GL_TEXTURE_2D, floorTexture);
 		depthShader.setMat4("model", glm::mat4());
 		glDrawArrays(GL_TRIANGLES, 0, 6);
-		glBindVertexArray(0);
+		glState.BindVertexArray(0);
 
-		model = glm::mat4();
-		depthShader.setMat4("model", model);
-		rotatedBox.Draw(depthShader);
+		lodSelector.SetView(camera, (float)SCR_HEIGHT);
+		scene.UpdateLods(lodSelector);
 
-		shader.use();
-		shader.setMat4("projection", projection);
-		shader.setMat4("view", view);
+		occlusion.Begin(projection * view);
+		for (unsigned int occluder : occluders)
+		{
+			const SceneInstance &instance = scene.GetInstance(occluder);
+			occlusion.AddOccluder(*instance.mesh, instance.transform);
+		}
+		occlusion.Rasterize();
+		scene.Submit(renderQueue, RENDER_PASS_OPAQUE, depthShader, frustum, &occlusion);
+
+		// what's under the cursor
+		double cursorX, cursorY;
+		int windowWidth, windowHeight;
+		glfwGetCursorPos(window, &cursorX, &cursorY);
+		glfwGetWindowSize(window, &windowWidth, &windowHeight);
+		double pickStart = glfwGetTime();
+		Ray cursorRay = CameraRay(camera, (float)cursorX, (float)cursorY, (float)windowWidth, (float)windowHeight);
+		hovering = picker.Pick(scene, cursorRay, farPlane, hoveredPick);
+		pickTime = glfwGetTime() - pickStart;
 
-		shader.setVec3("viewPos", camera.Position);
+		shader.use();
 		shader.setFloat("material.shininess", 32.0f);
 		
-		/*
-		Here we set all the uniforms for the 5/6 types of lights we have. We have to set them manually and index
-		the proper PointLight struct in the array to set each uniform variable. This can be done more code-friendly
-		by defining light types as classes and set their values in there, or by using a more efficient uniform approach
-		by using 'Uniform buffer objects', but that is something we'll discuss in the 'Advanced GLSL' tutorial.
-		*/
-		// directional light
-		shader.setVec3("dirLight.direction", directionalLight.direction);
-		shader.setVec3("dirLight.ambient", directionalLight.ambient);
-		shader.setVec3("dirLight.diffuse", directionalLight.diffuse);
-		shader.setVec3("dirLight.specular", directionalLight.specular);
-
-		// point lights
-		for (int i = 0; i < 4; i++) {
-			shader.setVec3("pointLights[" + std::to_string(i) + "].position",	pointLights[i].position);
-			shader.setVec3("pointLights[" + std::to_string(i) + "].ambient",	pointLights[i].ambient);
-			shader.setVec3("pointLights[" + std::to_string(i) + "].diffuse",	pointLights[i].diffuse);
-			shader.setVec3("pointLights[" + std::to_string(i) + "].specular",	pointLights[i].specular);
-			shader.setFloat("pointLights[" + std::to_string(i) + "].constant",	pointLights[i].constant);
-			shader.setFloat("pointLights[" + std::to_string(i) + "].linear",	pointLights[i].linear);
-			shader.setFloat("pointLights[" + std::to_string(i) + "].quadratic", pointLights[i].quadratic);
-		}
-		// spotLight
-		shader.setVec3("spotLight.position", camera.Position);
-		shader.setVec3("spotLight.direction", camera.Front);
-		shader.setVec3("spotLight.ambient", 0.0f, 0.0f, 0.0f);
-		shader.setVec3("spotLight.diffuse", 1.0f, 1.0f, 1.0f);
-		shader.setVec3("spotLight.specular", 1.0f, 1.0f, 1.0f);
-		shader.setFloat("spotLight.constant", 1.0f);
-		shader.setFloat("spotLight.linear", 0.09f);
-		shader.setFloat("spotLight.quadratic", 0.032f);
-		shader.setFloat("spotLight.cutOff", glm::cos(glm::radians(12.5f)));
-		shader.setFloat("spotLight.outerCutOff", glm::cos(glm::radians(15.0f)));
-		
-		shader.setBool("useSpotLight", true);
-		
 		// render the loaded models
 		//glm::mat4 model;
 
 		testShader.use();
-		testShader.setMat4("projection", projection);
-		testShader.setMat4("view", view);
 		model = glm::mat4();
 		model = glm::translate(model, glm::vec3(3.0f, 0.0f, 3.0f));
 		model = glm::scale(model, glm::vec3(1.0f, 1.0f, 1.0f));
@@ -453,7 +602,6 @@ int main()
 		testShader.setVec3("objectColor", objectColor);
 		testShader.setVec3("lightColor", lightColor);
 		testShader.setVec3("lightPos", light.position);
-		testShader.setVec3("viewPos", camera.Position);
 		
 		testShader.setVec3("light.ambient", light.ambient);
 		testShader.setVec3("light.diffuse", light.diffuse);
@@ -469,6 +617,7 @@ int main()
 
 
 		shader.use();
+		characterInstances.clear();
 		for (int i = 0; i < 1; i++) {
 			for (int j = 0; j < 1; j++) {
 				model = glm::mat4();
@@ -476,10 +625,11 @@ int main()
 				model = glm::translate(model, glm::vec3(0.8f * i, -0.5f, 0.8f * j));
 				model = glm::scale(model, glm::vec3(0.1f, 0.1f, 0.1f));
 				//model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
-				shader.setMat4("model", model);
-				//lowpolycharacter.Draw(shader);
+				characterInstances.push_back(model);
 			}
 		}
+		// the whole grid is a single draw per sub-mesh
+		lowpolycharacter.DrawInstanced(shader, characterInstances);
 
 		model = glm::mat4();
 		model = glm::translate(model, glm::vec3(2.0f, -0.5f, 2.0f));
@@ -490,19 +640,27 @@ int main()
 
 		// also draw the lamp object(s)
 		lampShader.use();
-		lampShader.setMat4("projection", projection);
-		lampShader.setMat4("view", view);
 
-		// we now draw as many light bulbs as we have point lights.
-		for (unsigned int i = 0; i < 4; i++)
+		// we now draw as many light bulbs as we have point lights, all of them in one instanced draw
+		lampInstances.clear();
+		lampColors.clear();
+		for (unsigned int i = 0; i < NR_POINT_LIGHTS; i++)
 		{
 			model = glm::mat4();
 			model = glm::translate(model, pointLightPositions[i]);
 			model = glm::scale(model, glm::vec3(0.2f)); // Make it a smaller cube
-			lampShader.setMat4("model", model);
-			lampShader.setVec3("color", pointLights[i].diffuse);
-			//suzanne.Draw(lampShader);
+			lampInstances.push_back(model);
+			lampColors.push_back(glm::vec4(pointLights[i].diffuse, 1.0f));
 		}
+		suzanne.DrawInstanced(lampShader, lampInstances, lampColors);
+
+		renderQueue.Flush();
+
+		frameUniforms.EndFrame();
+		glState.EndFrame();
+
+		// upload textures that finished decoding, the rest waits for the next frame
+		textureStreamer.Update(2.0);
 
 		// glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
 		// -------------------------------------------------------------------------------
@@ -516,11 +674,113 @@ int main()
 	glDeleteVertexArrays(1, &planeVAO);
 	glDeleteBuffers(1, &cubeVBO);
 	glDeleteBuffers(1, &planeVBO);
+	// let decodes still in flight land, so the streamer gives back its references
+	textureStreamer.Finish();
+	suzanne.Release();
+	lowpolycharacter.Release();
+	town.Release();
+	nanosuit.Release();
+	rotatedBox.Release();
+	textureManager.Release(cubeTexture);
+	textureManager.Release(floorTexture);
+	textureStreamer.Release();
+	frameUniforms.Release();
 
 	// glfw: terminate, clearing all previously allocated GLFW resources.
 	// ------------------------------------------------------------------
 	glfwTerminate();
-	return 0;
+	return exitCode;
+}
+
+// draws the model framed from above into two offscreen targets, once with Draw and once with DrawBatched,
+// and counts the pixels that differ. the batched path keeps the per mesh draw order, so any differing pixel is a bug
+// ---------------------------------------------------------------------------------------------------------
+bool compareBatching(const char *name, Model &model, const Shader &shader, FrameUniforms &frameUniforms, const LightsBlock &lightsBlock)
+{
+	const int width = SCR_WIDTH, height = SCR_HEIGHT;
+	GLuint framebuffers[2], renderbuffers[4];
+	bool complete = true;
+	glGenFramebuffers(2, framebuffers);
+	glGenRenderbuffers(4, renderbuffers);
+	for (int i = 0; i < 2; i++)
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[i]);
+		glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[i * 2]);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[i * 2]);
+		glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[i * 2 + 1]);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[i * 2 + 1]);
+		complete &= glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	}
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	bool identical = true;
+	if (!complete)
+	{
+		std::cout << "ERROR::BATCH_COMPARE::FRAMEBUFFER_INCOMPLETE" << std::endl;
+		identical = false;
+	}
+	else
+	{
+		AABB bounds = model.Bounds();
+		glm::vec3 center = (bounds.min + bounds.max) * 0.5f;
+		float radius = std::max(glm::length(bounds.max - bounds.min) * 0.5f, 0.01f);
+		glm::vec3 eye = center + glm::normalize(glm::vec3(1.0f, 0.6f, 1.2f)) * radius * 2.0f;
+		CameraBlock cameraBlock;
+		cameraBlock.view = glm::lookAt(eye, center, glm::vec3(0.0f, 1.0f, 0.0f));
+		cameraBlock.projection = glm::perspective(glm::radians(45.0f), (float)width / (float)height, radius * 0.05f, radius * 5.0f);
+		cameraBlock.viewPos = glm::vec4(eye, 1.0f);
+
+		std::vector<unsigned char> pixels[2];
+		glViewport(0, 0, width, height);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		for (int path = 0; path < 2; path++)
+		{
+			glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[path]);
+			glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			frameUniforms.Update(cameraBlock, lightsBlock);
+			shader.use();
+			shader.setMat4("model", glm::mat4());
+			if (path == 0)
+			{
+				model.Draw(shader);
+			}
+			else
+			{
+				model.DrawBatched(shader);
+			}
+			frameUniforms.EndFrame();
+			pixels[path].resize((size_t)width * height * 4);
+			glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels[path].data());
+		}
+
+		// covered pixels are the ones the per mesh path drew, so an empty image doesn't pass silently
+		unsigned int covered = 0, differing = 0;
+		int largestDifference = 0;
+		for (size_t i = 0; i < (size_t)width * height; i++)
+		{
+			const unsigned char *a = &pixels[0][i * 4], *b = &pixels[1][i * 4];
+			covered += a[3] != 0;
+			int difference = 0;
+			for (int channel = 0; channel < 4; channel++)
+			{
+				difference = std::max(difference, std::abs((int)a[channel] - (int)b[channel]));
+			}
+			differing += difference != 0;
+			largestDifference = std::max(largestDifference, difference);
+		}
+		std::cout << "BATCH_COMPARE::" << name << " " << differing << " of " << covered << " covered pixels differ"
+			<< " (largest channel difference " << largestDifference << ")" << std::endl;
+		identical = differing == 0 && covered > 0;
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glDeleteFramebuffers(2, framebuffers);
+	glDeleteRenderbuffers(4, renderbuffers);
+	glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
+	return identical;
 }
 
 // process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
@@ -549,7 +809,26 @@ void processInput(GLFWwindow *window)
 void keyboard_callback(GLFWwindow *window, int key, int scancode, int action, int mods)
 {
 	if (key == GLFW_KEY_SPACE && action == GLFW_PRESS)
+	{
 		std::cout << camera.Position.x << ", " << camera.Position.y << ", " << camera.Position.z << std::endl;
+		if (hovering)
+		{
+			std::cout << "PICK::instance " << hoveredPick.instance << " triangle " << hoveredPick.triangle
+				<< " at " << hoveredPick.position.x << ", " << hoveredPick.position.y << ", " << hoveredPick.position.z
+				<< " (" << pickTime * 1000.0 << " ms)" << std::endl;
+		}
+		else
+		{
+			std::cout << "PICK::nothing under the cursor (" << pickTime * 1000.0 << " ms)" << std::endl;
+		}
+	}
+
+	// cull 100k boxes against the current view
+	if (key == GLFW_KEY_B && action == GLFW_PRESS)
+	{
+		glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+		RunCullingBenchmark(ExtractFrustum(projection * camera.GetViewMatrix()));
+	}
 }
 
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
@@ -584,41 +863,3 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 {
 	camera.ProcessMouseScroll((float)yoffset);
 }
-
-unsigned int LoadTexture(const char *path)
-{
-	unsigned int textureID;
-	glGenTextures(1, &textureID);
-
-	int width, height, nrComponents;
-	unsigned char *data = stbi_load(path, &width, &height, &nrComponents, 0);
-
-	if (data)
-	{
-		GLenum format;
-		if (nrComponents == 1)
-			format = GL_RED;
-		else if (nrComponents == 3)
-			format = GL_RGB;
-		else if (nrComponents == 4)
-			format = GL_RGBA;
-
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
-
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-		stbi_image_free(data);
-	}
-	else
-	{
-		std::cout << "Texture failed to load at path: " << path << std::endl;
-		stbi_image_free(data);
-	}
-
-	return textureID;
-}
\ No newline at end of file
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Read-only memory mapping of a whole file. The mapping lives as long as the object.
+class MappedFile
+{
+public:
+	/* Functions */
+	MappedFile();
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// map the file at path, returns false if it doesn't exist or can't be mapped
+	bool Open(const std::string &path);
+	void Close();
+
+	bool IsOpen() const { return data != nullptr; }
+	const unsigned char *Data() const { return data; }
+	size_t Size() const { return size; }
+
+private:
+	/* Mapping Data */
+	const unsigned char *data;
+	size_t size;
+#ifdef _WIN32
+	void *fileHandle;
+	void *mappingHandle;
+#else
+	int fileDescriptor;
+#endif
+};
@@ -1,60 +1,151 @@
 #include "Mesh.h"
 
+#include <algorithm>
 
-Mesh::Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures)
+
+Mesh::Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures,
+	MeshResidency residency)
+	: vertices(std::move(vertices)), indices(std::move(indices)), textures(std::move(textures)),
+	indexCount((unsigned int)this->indices.size()), indexType(GL_UNSIGNED_INT), indexOffset(0), baseVertex(0), residency(residency), format(VERTEX_FORMAT_FULL)
 {
-	this->vertices = vertices;
-	this->indices = indices;
-	this->textures = textures;
+	quantization.positionOffset = glm::vec3(0.0f);
+	quantization.positionScale = glm::vec3(1.0f);
+	bounds = ComputeBounds(this->vertices);
 
 	// now that we have all the required data, set the vertex buffers and its attribute pointers.
 	setupMesh();
+	setupSamplers();
+	applyResidency();
 }
 
-void Mesh::Draw(Shader shader)
+Mesh::Mesh(MeshData &&data, MeshResidency residency)
+	: vertices(std::move(data.vertices)), indices(std::move(data.indices)), textures(std::move(data.textures)),
+	indexCount((unsigned int)indices.size()), indexType(GL_UNSIGNED_INT), indexOffset(0), baseVertex(0),
+	residency(residency), format(data.format), quantization(data.quantization), bounds(data.bounds),
+	packedVertices(std::move(data.packedVertices)), lodIndices(std::move(data.lods))
 {
-	// bind appropriate textures
-	unsigned int diffuseNr = 1;
-	unsigned int specularNr = 1;
-	unsigned int normalNr = 1;
-	unsigned int heightNr = 1;
+	setupMesh();
+	setupSamplers();
+	applyResidency();
+}
 
-	for (unsigned int i = 0; i < textures.size(); i++)
+Mesh::Mesh(MeshData &&data, GeometryArena &arena, MeshResidency residency)
+	: vertices(std::move(data.vertices)), indices(std::move(data.indices)), textures(std::move(data.textures)),
+	VAO(arena.VAO), residency(residency), format(data.format), quantization(data.quantization), bounds(data.bounds),
+	VBO(0), EBO(0)
+{
+	const void *vertexData = format == VERTEX_FORMAT_PACKED ? (const void*)data.packedVertices.data() : (const void*)vertices.data();
+	GeometryRange range = arena.Add(vertexData, vertices.size(), indices);
+	indexCount = range.indexCount;
+	indexType = range.indexType;
+	indexOffset = range.indexOffset;
+	baseVertex = range.baseVertex;
+
+	// coarser levels only add indices, relative to the same base vertex
+	LodRange full = { indexOffset, indexCount, 0.0f };
+	lods.push_back(full);
+	for (const MeshLod &lod : data.lods)
 	{
-		glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-		// retrieve texture number (the N in diffuse_textureN)
-		std::string number;
-		std::string name = textures[i].type;
-		if (name == "texture_diffuse")
-		{
-			number = std::to_string(diffuseNr++);
-		}
-		else if (name == "texture_specular")
-		{
-			number = std::to_string(specularNr++); // transfer unsigned int to stream
-		}
-		else if (name == "texture_normal")
-		{
-			number = std::to_string(normalNr++);  // transfer unsigned int to stream
-		}
-		else if (name == "texture_height")
-		{
-			number = std::to_string(heightNr++); // transfer unsigned int to stream
-		}
+		LodRange level = { arena.AddIndices(lod.indices, indexType), (unsigned int)lod.indices.size(), lod.error };
+		lods.push_back(level);
+	}
+
+	setupSamplers();
+	applyResidency();
+}
 
-		// now set the sampler to the correct texture unit
-		glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-		// and finally bind the texture
-		glBindTexture(GL_TEXTURE_2D, textures[i].id);
+TextureSlot TextureSlotFromType(const std::string &type)
+{
+	if (type == "texture_diffuse")
+	{
+		return TEXTURE_DIFFUSE;
 	}
+	if (type == "texture_specular")
+	{
+		return TEXTURE_SPECULAR;
+	}
+	if (type == "texture_normal")
+	{
+		return TEXTURE_NORMAL;
+	}
+	if (type == "texture_height")
+	{
+		return TEXTURE_HEIGHT;
+	}
+	return TEXTURE_UNKNOWN;
+}
 
-	// draw mesh
-	glBindVertexArray(VAO);
-	glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-	glBindVertexArray(0);
+void Mesh::Draw(const Shader &shader)
+{
+	BindMaterial(shader);
+
+	// draw mesh, the VAO stays bound since every bind goes through the state tracker
+	GLState &state = GLState::Shared();
+	state.BindVertexArray(VAO);
+	DrawElements();
 
 	// always good practice to set everything back to default once configured;
-	glActiveTexture(GL_TEXTURE0);
+	state.ActiveTexture(GL_TEXTURE0);
+}
+
+void Mesh::BindMaterial(const Shader &shader)
+{
+	// bind appropriate textures
+	const ProgramBindings &bindings = bindingsFor(shader);
+	GLState &state = GLState::Shared();
+	for (unsigned int i = 0; i < samplers.size(); i++)
+	{
+		// set the sampler to the correct texture unit
+		glUniform1i(bindings.locations[i], i);
+		// and bind the texture, the unit is only activated if the binding changes
+		state.BindTextureUnit(i, GL_TEXTURE_2D, samplers[i].id);
+	}
+
+	// tell the vertex shader how to decode this mesh's vertices
+	if (bindings.packedVertex != -1)
+	{
+		glUniform1i(bindings.packedVertex, format == VERTEX_FORMAT_PACKED);
+		glUniform3fv(bindings.positionOffset, 1, &quantization.positionOffset[0]);
+		glUniform3fv(bindings.positionScale, 1, &quantization.positionScale[0]);
+	}
+}
+
+void Mesh::DrawElements(unsigned int lod) const
+{
+	const LodRange &range = lods[std::min(lod, (unsigned int)lods.size() - 1)];
+	glDrawElementsBaseVertex(GL_TRIANGLES, range.indexCount, indexType, (void*)range.indexOffset, baseVertex);
+}
+
+void Mesh::DrawElementsInstanced(GLsizei instanceCount, unsigned int lod) const
+{
+	const LodRange &range = lods[std::min(lod, (unsigned int)lods.size() - 1)];
+	glDrawElementsInstancedBaseVertex(GL_TRIANGLES, range.indexCount, indexType, (void*)range.indexOffset, instanceCount, baseVertex);
+}
+
+bool Mesh::CanBatchWith(const Mesh &other) const
+{
+	if (VAO != other.VAO || indexType != other.indexType || format != other.format || samplers.size() != other.samplers.size())
+	{
+		return false;
+	}
+
+	// packed positions are decoded with per mesh uniforms
+	if (format == VERTEX_FORMAT_PACKED
+		&& (quantization.positionOffset != other.quantization.positionOffset
+			|| quantization.positionScale != other.quantization.positionScale))
+	{
+		return false;
+	}
+
+	for (unsigned int i = 0; i < samplers.size(); i++)
+	{
+		if (samplers[i].slot != other.samplers[i].slot || samplers[i].number != other.samplers[i].number
+			|| samplers[i].id != other.samplers[i].id)
+		{
+			return false;
+		}
+	}
+	return true;
 }
 
 Mesh::~Mesh()
@@ -68,36 +159,154 @@ void Mesh::setupMesh()
 	glGenBuffers(1, &VBO);
 	glGenBuffers(1, &EBO);
 
-	glBindVertexArray(VAO);
+	GLState::Shared().BindVertexArray(VAO);
 	// load data into vertex buffers
 	glBindBuffer(GL_ARRAY_BUFFER, VBO);
 
 	// because a struct is sequential we can simply pass the pointer to the struct.
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+	if (format == VERTEX_FORMAT_PACKED)
+	{
+		glBufferData(GL_ARRAY_BUFFER, packedVertices.size() * sizeof(PackedVertex), packedVertices.data(), GL_STATIC_DRAW);
+	}
+	else
+	{
+		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+	}
 
+	// the levels of detail follow the full index list in the same buffer
+	LodRange full = { 0, indexCount, 0.0f };
+	lods.assign(1, full);
+	size_t totalIndices = indices.size();
+	for (const MeshLod &lod : lodIndices)
+	{
+		LodRange level = { totalIndices, (unsigned int)lod.indices.size(), lod.error };
+		lods.push_back(level);
+		totalIndices += lod.indices.size();
+	}
+
+	// filled straight from the separate lists, without first joining them into one more 32 bit copy
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+	if (vertices.size() < MAX_SHORT_INDEX_VERTICES)
+	{
+		// half the index memory and bandwidth, the CPU copy stays 32 bit
+		std::vector<unsigned short> shortIndices;
+		shortIndices.reserve(totalIndices);
+		shortIndices.assign(indices.begin(), indices.end());
+		for (const MeshLod &lod : lodIndices)
+		{
+			shortIndices.insert(shortIndices.end(), lod.indices.begin(), lod.indices.end());
+		}
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * sizeof(unsigned short), shortIndices.data(), GL_STATIC_DRAW);
+		indexType = GL_UNSIGNED_SHORT;
+	}
+	else if (lodIndices.empty())
+	{
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+		indexType = GL_UNSIGNED_INT;
+	}
+	else
+	{
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, totalIndices * sizeof(unsigned int), NULL, GL_STATIC_DRAW);
+		glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, indices.size() * sizeof(unsigned int), indices.data());
+		for (unsigned int i = 0; i < lodIndices.size(); i++)
+		{
+			glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, lods[i + 1].indexOffset * sizeof(unsigned int),
+				lodIndices[i].indices.size() * sizeof(unsigned int), lodIndices[i].indices.data());
+		}
+		indexType = GL_UNSIGNED_INT;
+	}
+	std::vector<MeshLod>().swap(lodIndices);
+	// offsets were counted in indices until the index size was known
+	size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+	for (LodRange &range : lods)
+	{
+		range.indexOffset *= indexSize;
+	}
 
 	// set the vertex attribute pointers
-	// vertex positions
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+	SetupVertexAttributes(format);
+
+	GLState::Shared().BindVertexArray(0);
+
+	// the packed copy is never read on the CPU
+	std::vector<PackedVertex>().swap(packedVertices);
+}
+
+void Mesh::applyResidency()
+{
+	if (residency == MESH_KEEP_ALL)
+	{
+		return;
+	}
 
-	// vertex normals
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+	if (residency == MESH_KEEP_POSITIONS)
+	{
+		positions.reserve(vertices.size());
+		for (const Vertex &vertex : vertices)
+		{
+			positions.push_back(vertex.Position);
+		}
+	}
+	else
+	{
+		std::vector<unsigned int>().swap(indices);
+	}
+	// swap with an empty vector, clear() alone keeps the capacity
+	std::vector<Vertex>().swap(vertices);
+}
 
-	// vertex texture coords
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+void Mesh::setupSamplers()
+{
+	// retrieve texture number (the N in diffuse_textureN) once instead of every draw
+	unsigned int slotCounts[TEXTURE_UNKNOWN + 1] = {};
 
-	// vertex tangent
-	glEnableVertexAttribArray(3);
-	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
+	samplers.reserve(textures.size());
+	for (unsigned int i = 0; i < textures.size(); i++)
+	{
+		SamplerBinding sampler;
+		sampler.slot = TextureSlotFromType(textures[i].type);
+		sampler.number = ++slotCounts[sampler.slot];
+		sampler.id = textures[i].id;
+		samplers.push_back(sampler);
+	}
 
-	// vertex bitantent
-	glEnableVertexAttribArray(4);
-	glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+	// FNV-1a over the texture handles
+	materialKey = 2166136261u;
+	for (const SamplerBinding &sampler : samplers)
+	{
+		materialKey ^= sampler.id;
+		materialKey *= 16777619u;
+	}
+}
 
-	glBindVertexArray(0);
+const Mesh::ProgramBindings &Mesh::bindingsFor(const Shader &shader)
+{
+	for (const ProgramBindings &bindings : programBindings)
+	{
+		if (bindings.program == shader.ID)
+		{
+			return bindings;
+		}
+	}
+
+	// first draw with this program, the only time sampler names are built
+	static const char *slotNames[] = { "texture_diffuse", "texture_specular", "texture_normal", "texture_height" };
+
+	ProgramBindings bindings;
+	bindings.program = shader.ID;
+	bindings.packedVertex = shader.getUniformLocation("packedVertex");
+	bindings.positionOffset = shader.getUniformLocation("positionOffset");
+	bindings.positionScale = shader.getUniformLocation("positionScale");
+	bindings.locations.reserve(samplers.size());
+	for (const SamplerBinding &sampler : samplers)
+	{
+		GLint location = -1;
+		if (sampler.slot != TEXTURE_UNKNOWN)
+		{
+			location = shader.getUniformLocation(slotNames[sampler.slot] + std::to_string(sampler.number));
+		}
+		bindings.locations.push_back(location);
+	}
+	programBindings.push_back(bindings);
+	return programBindings.back();
 }
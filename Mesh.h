@@ -4,6 +4,10 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "Shader.h"
+#include "Vertex.h"
+#include "GeometryArena.h"
+#include "GLState.h"
+#include "Culling.h"
 
 #include <string>
 #include <fstream>
@@ -11,25 +15,57 @@
 #include <iostream>
 #include <vector>
 
-struct Vertex {
-	// position
-	glm::vec3 Position;
-	// normal
-	glm::vec3 Normal;
-	// texture coordinates
-	glm::vec2 TexCoords;
-	// tangent
-	glm::vec3 Tangent;
-	// bitangent
-	glm::vec3 Bitangent;
-};
-
 struct Texture {
 	unsigned int id;
 	std::string type;
 	std::string path;
 };
 
+// material texture slots, sampled as texture_diffuseN, texture_specularN, ... in the shaders
+enum TextureSlot {
+	TEXTURE_DIFFUSE,
+	TEXTURE_SPECULAR,
+	TEXTURE_NORMAL,
+	TEXTURE_HEIGHT,
+	TEXTURE_UNKNOWN
+};
+
+TextureSlot TextureSlotFromType(const std::string &type);
+
+// a coarser version of a mesh, indexing the same vertices
+struct MeshLod {
+	std::vector<unsigned int> indices;
+	float error;	// how far the surface may be off, in object space units
+};
+
+// CPU side mesh data, filled by the importer before anything is uploaded to GL
+struct MeshData {
+	std::vector<Vertex> vertices;
+	std::vector<unsigned int> indices;
+	std::vector<Texture> textures;
+
+	// VERTEX_FORMAT_PACKED meshes are quantized at import time into packedVertices
+	VertexFormat format = VERTEX_FORMAT_FULL;
+	std::vector<PackedVertex> packedVertices;
+	VertexQuantization quantization;
+
+	// object space bounds, filled by the importer
+	MeshBounds bounds;
+
+	// levels of detail below the full mesh, each coarser than the one before
+	std::vector<MeshLod> lods;
+};
+
+// what a mesh keeps in host memory once its buffers are on the GPU
+enum MeshResidency {
+	MESH_KEEP_ALL,				// vertices and indices stay available
+	MESH_DROP_AFTER_UPLOAD,		// only the GPU copy remains
+	MESH_KEEP_POSITIONS			// positions and indices stay for picking/culling, the rest is dropped
+};
+
+// meshes with fewer vertices than this are drawn with 16 bit indices
+const size_t MAX_SHORT_INDEX_VERTICES = 65536;
+
 class Mesh
 {
 public:
@@ -37,22 +73,90 @@ public:
 	std::vector<Vertex> vertices;
 	std::vector<unsigned int> indices;
 	std::vector<Texture> textures;
+	// only filled with MESH_KEEP_POSITIONS
+	std::vector<glm::vec3> positions;
 	unsigned int VAO;
+	unsigned int indexCount;
+	// GL_UNSIGNED_SHORT when every index fits, GL_UNSIGNED_INT otherwise
+	GLenum indexType;
+	// where the mesh starts in the (possibly shared) buffers, 0 for meshes with their own buffers
+	size_t indexOffset;
+	GLint baseVertex;
+	// index ranges of the levels of detail, all in the same buffers. level 0 is the full mesh
+	struct LodRange {
+		size_t indexOffset;
+		unsigned int indexCount;
+		float error;
+	};
+	std::vector<LodRange> lods;
+	MeshResidency residency;
+	VertexFormat format;
+	VertexQuantization quantization;
+	// object space bounds, kept whatever the residency
+	MeshBounds bounds;
 
 	/* Functions */
-	// constructor
-	Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures);
+	// constructor, takes ownership of the vectors (pass them with std::move to avoid copies)
+	Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures,
+		MeshResidency residency = MESH_KEEP_ALL);
+	Mesh(MeshData &&data, MeshResidency residency = MESH_KEEP_ALL);
+	// sub-allocates the geometry from an arena of the same vertex format instead of creating buffers,
+	// the mesh can't be drawn before the arena is uploaded
+	Mesh(MeshData &&data, GeometryArena &arena, MeshResidency residency = MESH_KEEP_ALL);
+
+	// meshes own GL handles, so they're moved around but never copied
+	Mesh(Mesh &&other) noexcept = default;
+	Mesh& operator=(Mesh &&other) noexcept = default;
+	Mesh(const Mesh&) = delete;
+	Mesh& operator=(const Mesh&) = delete;
 	
 	// render the mesh
-	void Draw(Shader shader);
+	void Draw(const Shader &shader);
+	// the two halves of Draw, so callers sharing a VAO between meshes only bind it once
+	void BindMaterial(const Shader &shader);
+	void DrawElements(unsigned int lod = 0) const;
+	void DrawElementsInstanced(GLsizei instanceCount, unsigned int lod = 0) const;
+	// true when both meshes can go into one multi-draw: same buffers, index type, textures and vertex decoding
+	bool CanBatchWith(const Mesh &other) const;
+	// hash of the bound textures, meshes with the same material share the key (collisions are possible)
+	unsigned int MaterialKey() const { return materialKey; }
+	unsigned int LodCount() const { return (unsigned int)lods.size(); }
 	~Mesh();
 
 private:
 	/* Render Data */
 	unsigned int VBO, EBO;
+	// only alive until setupMesh uploaded it
+	std::vector<PackedVertex> packedVertices;
+	// indices of the coarser levels, only alive until they're uploaded
+	std::vector<MeshLod> lodIndices;
+
+	// one entry per texture, resolved once from the texture type strings
+	struct SamplerBinding {
+		TextureSlot slot;
+		unsigned int number;
+		unsigned int id;
+	};
+	std::vector<SamplerBinding> samplers;
+	unsigned int materialKey;
+
+	// sampler uniform locations of every program this mesh has been drawn with
+	struct ProgramBindings {
+		unsigned int program;
+		std::vector<GLint> locations;
+		// vertex decoding uniforms, -1 if the program can't decode packed vertices
+		GLint packedVertex;
+		GLint positionOffset;
+		GLint positionScale;
+	};
+	std::vector<ProgramBindings> programBindings;
 
 	/* Functions */
 	// initialize all the buffer objects/arrays
 	void setupMesh();
+	void setupSamplers();
+	// release host memory according to the residency policy
+	void applyResidency();
+	const ProgramBindings &bindingsFor(const Shader &shader);
 };
 
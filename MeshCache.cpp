@@ -0,0 +1,242 @@
+#include "MeshCache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+static const char MESH_CACHE_MAGIC[4] = { 'M', 'S', 'H', 'C' };
+
+// FNV-1a, stable across runs and platforms
+static uint64_t hashString(const std::string &value)
+{
+	uint64_t hash = 14695981039346656037ull;
+	for (unsigned char c : value)
+	{
+		hash ^= c;
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+static uint64_t sourceModifiedTime(const std::string &path)
+{
+#ifdef _WIN32
+	struct _stat64 fileStat;
+	if (_stat64(path.c_str(), &fileStat) != 0)
+	{
+		return 0;
+	}
+#else
+	struct stat fileStat;
+	if (stat(path.c_str(), &fileStat) != 0)
+	{
+		return 0;
+	}
+#endif
+	return (uint64_t)fileStat.st_mtime;
+}
+
+static uint64_t alignOffset(uint64_t offset, uint64_t alignment)
+{
+	return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+static void writePadding(std::ofstream &out, uint64_t from, uint64_t to)
+{
+	static const char zeros[16] = {};
+	out.write(zeros, (std::streamsize)(to - from));
+}
+
+std::string MeshCache::CachePath(const std::string &sourcePath)
+{
+	return sourcePath + ".meshcache";
+}
+
+bool MeshCache::Write(const std::string &sourcePath, unsigned int importFlags, unsigned int processFlags, const std::vector<MeshData> &meshes)
+{
+	uint64_t modified = sourceModifiedTime(sourcePath);
+	if (modified == 0)
+	{
+		return false;
+	}
+
+	MeshCacheHeader cacheHeader = {};
+	std::memcpy(cacheHeader.magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC));
+	cacheHeader.version = MESH_CACHE_VERSION;
+	cacheHeader.importFlags = importFlags;
+	cacheHeader.vertexSize = sizeof(Vertex);
+	cacheHeader.sourceModified = modified;
+	cacheHeader.sourcePathHash = hashString(sourcePath);
+	cacheHeader.meshCount = (uint32_t)meshes.size();
+	cacheHeader.processFlags = processFlags;
+
+	// lay out every array first so the entry table can be written up front
+	std::vector<MeshCacheEntry> cacheEntries(meshes.size());
+	uint64_t offset = sizeof(MeshCacheHeader) + meshes.size() * sizeof(MeshCacheEntry);
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		const MeshData &mesh = meshes[i];
+		MeshCacheEntry &entry = cacheEntries[i];
+		entry.vertexCount = (uint32_t)mesh.vertices.size();
+		entry.indexCount = (uint32_t)mesh.indices.size();
+		entry.textureCount = (uint32_t)mesh.textures.size();
+
+		offset = alignOffset(offset, 16);
+		entry.vertexOffset = offset;
+		offset += mesh.vertices.size() * sizeof(Vertex);
+
+		offset = alignOffset(offset, 16);
+		entry.indexOffset = offset;
+		offset += mesh.indices.size() * sizeof(unsigned int);
+
+		offset = alignOffset(offset, 16);
+		entry.textureOffset = offset;
+		for (const Texture &texture : mesh.textures)
+		{
+			offset += 2 * sizeof(uint32_t) + texture.type.size() + texture.path.size();
+			offset = alignOffset(offset, 4);
+		}
+	}
+
+	// write to a temporary file so a crash never leaves a half written cache behind
+	std::string cachePath = CachePath(sourcePath);
+	std::string tempPath = cachePath + ".tmp";
+	std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+	if (!out)
+	{
+		return false;
+	}
+
+	out.write(reinterpret_cast<const char*>(&cacheHeader), sizeof(cacheHeader));
+	out.write(reinterpret_cast<const char*>(cacheEntries.data()), (std::streamsize)(cacheEntries.size() * sizeof(MeshCacheEntry)));
+
+	uint64_t written = sizeof(MeshCacheHeader) + cacheEntries.size() * sizeof(MeshCacheEntry);
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		const MeshData &mesh = meshes[i];
+		const MeshCacheEntry &entry = cacheEntries[i];
+
+		writePadding(out, written, entry.vertexOffset);
+		out.write(reinterpret_cast<const char*>(mesh.vertices.data()), (std::streamsize)(mesh.vertices.size() * sizeof(Vertex)));
+		written = entry.vertexOffset + mesh.vertices.size() * sizeof(Vertex);
+
+		writePadding(out, written, entry.indexOffset);
+		out.write(reinterpret_cast<const char*>(mesh.indices.data()), (std::streamsize)(mesh.indices.size() * sizeof(unsigned int)));
+		written = entry.indexOffset + mesh.indices.size() * sizeof(unsigned int);
+
+		writePadding(out, written, entry.textureOffset);
+		written = entry.textureOffset;
+		for (const Texture &texture : mesh.textures)
+		{
+			uint32_t lengths[2] = { (uint32_t)texture.type.size(), (uint32_t)texture.path.size() };
+			out.write(reinterpret_cast<const char*>(lengths), sizeof(lengths));
+			out.write(texture.type.data(), (std::streamsize)texture.type.size());
+			out.write(texture.path.data(), (std::streamsize)texture.path.size());
+			uint64_t end = written + sizeof(lengths) + texture.type.size() + texture.path.size();
+			written = alignOffset(end, 4);
+			writePadding(out, end, written);
+		}
+	}
+
+	out.close();
+	if (!out)
+	{
+		std::remove(tempPath.c_str());
+		return false;
+	}
+
+	std::remove(cachePath.c_str());
+	if (std::rename(tempPath.c_str(), cachePath.c_str()) != 0)
+	{
+		std::remove(tempPath.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool MeshCache::Open(const std::string &sourcePath, unsigned int importFlags, unsigned int processFlags)
+{
+	header = nullptr;
+	entries = nullptr;
+
+	if (!file.Open(CachePath(sourcePath)))
+	{
+		return false;
+	}
+
+	const unsigned char *data = file.Data();
+	size_t size = file.Size();
+	if (size < sizeof(MeshCacheHeader))
+	{
+		file.Close();
+		return false;
+	}
+
+	const MeshCacheHeader *cacheHeader = reinterpret_cast<const MeshCacheHeader*>(data);
+	bool valid = std::memcmp(cacheHeader->magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC)) == 0
+		&& cacheHeader->version == MESH_CACHE_VERSION
+		&& cacheHeader->importFlags == importFlags
+		&& cacheHeader->processFlags == processFlags
+		&& cacheHeader->vertexSize == sizeof(Vertex)
+		&& cacheHeader->sourcePathHash == hashString(sourcePath)
+		&& cacheHeader->sourceModified == sourceModifiedTime(sourcePath)
+		&& sizeof(MeshCacheHeader) + (uint64_t)cacheHeader->meshCount * sizeof(MeshCacheEntry) <= size;
+
+	// make sure no entry points outside of the file
+	const MeshCacheEntry *cacheEntries = reinterpret_cast<const MeshCacheEntry*>(data + sizeof(MeshCacheHeader));
+	for (uint32_t i = 0; valid && i < cacheHeader->meshCount; i++)
+	{
+		const MeshCacheEntry &entry = cacheEntries[i];
+		valid = entry.vertexOffset + (uint64_t)entry.vertexCount * sizeof(Vertex) <= size
+			&& entry.indexOffset + (uint64_t)entry.indexCount * sizeof(unsigned int) <= size
+			&& entry.textureOffset <= size;
+	}
+
+	if (!valid)
+	{
+		file.Close();
+		return false;
+	}
+
+	header = cacheHeader;
+	entries = cacheEntries;
+	return true;
+}
+
+CachedMesh MeshCache::GetMesh(unsigned int index) const
+{
+	const unsigned char *data = file.Data();
+	const MeshCacheEntry &entry = entries[index];
+
+	CachedMesh mesh;
+	mesh.vertices = reinterpret_cast<const Vertex*>(data + entry.vertexOffset);
+	mesh.vertexCount = entry.vertexCount;
+	mesh.indices = reinterpret_cast<const unsigned int*>(data + entry.indexOffset);
+	mesh.indexCount = entry.indexCount;
+
+	uint64_t offset = entry.textureOffset;
+	for (uint32_t i = 0; i < entry.textureCount; i++)
+	{
+		if (offset + 2 * sizeof(uint32_t) > file.Size())
+		{
+			break;
+		}
+		uint32_t lengths[2];
+		std::memcpy(lengths, data + offset, sizeof(lengths));
+		offset += sizeof(lengths);
+		if (offset + lengths[0] + lengths[1] > file.Size())
+		{
+			break;
+		}
+
+		CachedTexture texture;
+		texture.type.assign(reinterpret_cast<const char*>(data + offset), lengths[0]);
+		texture.path.assign(reinterpret_cast<const char*>(data + offset + lengths[0]), lengths[1]);
+		mesh.textures.push_back(texture);
+		offset = alignOffset(offset + lengths[0] + lengths[1], 4);
+	}
+	return mesh;
+}
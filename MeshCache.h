@@ -0,0 +1,78 @@
+#pragma once
+
+#include "MappedFile.h"
+#include "Mesh.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Binary cache of fully processed meshes, written next to the source model as "<model>.meshcache".
+// The file is memory mapped on load so vertex and index arrays can be handed to GL without any parsing.
+// A cache is only used when the source path, modification time, import and process flags and Vertex layout all match.
+
+const uint32_t MESH_CACHE_VERSION = 3;
+
+// processing applied after the import, part of the cache key
+enum MeshCacheProcess {
+	MESH_PROCESS_OPTIMIZE = 1 << 0,		// welded and reordered for the vertex cache and fetch
+	MESH_PROCESS_OVERDRAW = 1 << 1		// triangle clusters sorted for overdraw
+};
+
+struct MeshCacheHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t importFlags;
+	uint32_t vertexSize;
+	uint64_t sourceModified;
+	uint64_t sourcePathHash;
+	uint32_t meshCount;
+	uint32_t processFlags;
+};
+
+struct MeshCacheEntry {
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint32_t textureCount;
+	uint32_t reserved;
+	uint64_t vertexOffset;
+	uint64_t indexOffset;
+	uint64_t textureOffset;
+};
+
+struct CachedTexture {
+	std::string type;
+	std::string path;
+};
+
+struct CachedMesh {
+	// these point straight into the mapped file
+	const Vertex *vertices;
+	uint32_t vertexCount;
+	const unsigned int *indices;
+	uint32_t indexCount;
+	std::vector<CachedTexture> textures;
+};
+
+class MeshCache
+{
+public:
+	/* Functions */
+	// returns the cache file used for a source model
+	static std::string CachePath(const std::string &sourcePath);
+
+	// writes the processed meshes of a model, returns false if the cache couldn't be written
+	static bool Write(const std::string &sourcePath, unsigned int importFlags, unsigned int processFlags, const std::vector<MeshData> &meshes);
+
+	// maps the cache for sourcePath, returns false when it's missing, stale or corrupt
+	bool Open(const std::string &sourcePath, unsigned int importFlags, unsigned int processFlags);
+
+	unsigned int MeshCount() const { return header ? header->meshCount : 0; }
+	CachedMesh GetMesh(unsigned int index) const;
+
+private:
+	/* Cache Data */
+	MappedFile file;
+	const MeshCacheHeader *header = nullptr;
+	const MeshCacheEntry *entries = nullptr;
+};
@@ -0,0 +1,690 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+
+// Forsyth scoring constants, see "Linear-Speed Vertex Cache Optimisation"
+static const int FORSYTH_CACHE_SIZE = 32;
+static const float CACHE_DECAY_POWER = 1.5f;
+static const float LAST_TRIANGLE_SCORE = 0.75f;
+static const float VALENCE_BOOST_SCALE = 2.0f;
+static const float VALENCE_BOOST_POWER = 0.5f;
+
+struct VertexBytesHash {
+	size_t operator()(const Vertex &vertex) const
+	{
+		// FNV-1a over the raw attribute bytes, Vertex is all floats so there is no padding
+		const unsigned char *bytes = reinterpret_cast<const unsigned char*>(&vertex);
+		size_t hash = (size_t)2166136261u;
+		for (size_t i = 0; i < sizeof(Vertex); i++)
+		{
+			hash ^= bytes[i];
+			hash *= (size_t)16777619u;
+		}
+		return hash;
+	}
+};
+
+struct VertexBytesEqual {
+	bool operator()(const Vertex &a, const Vertex &b) const
+	{
+		return std::memcmp(&a, &b, sizeof(Vertex)) == 0;
+	}
+};
+
+size_t WeldVertices(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices)
+{
+	std::unordered_map<Vertex, unsigned int, VertexBytesHash, VertexBytesEqual> unique;
+	unique.reserve(vertices.size());
+
+	std::vector<unsigned int> remap(vertices.size());
+	std::vector<Vertex> welded;
+	welded.reserve(vertices.size());
+	for (size_t i = 0; i < vertices.size(); i++)
+	{
+		auto inserted = unique.insert(std::make_pair(vertices[i], (unsigned int)welded.size()));
+		if (inserted.second)
+		{
+			welded.push_back(vertices[i]);
+		}
+		remap[i] = inserted.first->second;
+	}
+
+	for (unsigned int &index : indices)
+	{
+		index = remap[index];
+	}
+
+	size_t removed = vertices.size() - welded.size();
+	vertices.swap(welded);
+	return removed;
+}
+
+static float vertexScore(int cachePosition, unsigned int remainingTriangles)
+{
+	if (remainingTriangles == 0)
+	{
+		return -1.0f; // nothing left to draw with this vertex
+	}
+
+	float score = 0.0f;
+	if (cachePosition >= 0)
+	{
+		if (cachePosition < 3)
+		{
+			// the last triangle's vertices are penalised so strips don't just bounce back and forth
+			score = LAST_TRIANGLE_SCORE;
+		}
+		else
+		{
+			float scaler = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+			score = std::pow(1.0f - (cachePosition - 3) * scaler, CACHE_DECAY_POWER);
+		}
+	}
+
+	// favour vertices with few triangles left, finishing them frees up the cache
+	score += VALENCE_BOOST_SCALE * std::pow((float)remainingTriangles, -VALENCE_BOOST_POWER);
+	return score;
+}
+
+void OptimizeVertexCache(std::vector<unsigned int> &indices, size_t vertexCount)
+{
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0)
+	{
+		return;
+	}
+
+	// vertex -> triangle adjacency in compressed rows
+	std::vector<unsigned int> adjacencyOffsets(vertexCount + 1, 0);
+	for (unsigned int index : indices)
+	{
+		adjacencyOffsets[index + 1]++;
+	}
+	for (size_t i = 0; i < vertexCount; i++)
+	{
+		adjacencyOffsets[i + 1] += adjacencyOffsets[i];
+	}
+	std::vector<unsigned int> adjacency(indices.size());
+	std::vector<unsigned int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		adjacency[fill[indices[i]]++] = (unsigned int)(i / 3);
+	}
+
+	std::vector<unsigned int> remaining(vertexCount);
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> scores(vertexCount);
+	for (size_t i = 0; i < vertexCount; i++)
+	{
+		remaining[i] = adjacencyOffsets[i + 1] - adjacencyOffsets[i];
+		scores[i] = vertexScore(-1, remaining[i]);
+	}
+
+	std::vector<float> triangleScores(triangleCount);
+	std::vector<bool> emitted(triangleCount, false);
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		triangleScores[t] = scores[indices[t * 3]] + scores[indices[t * 3 + 1]] + scores[indices[t * 3 + 2]];
+	}
+
+	std::vector<unsigned int> output;
+	output.reserve(indices.size());
+
+	// LRU cache, with room for the three vertices pushed in front of it
+	std::vector<unsigned int> cache;
+	std::vector<unsigned int> nextCache;
+	cache.reserve(FORSYTH_CACHE_SIZE + 3);
+	nextCache.reserve(FORSYTH_CACHE_SIZE + 3);
+
+	size_t scanCursor = 0;
+	long long bestTriangle = -1;
+	while (output.size() < indices.size())
+	{
+		if (bestTriangle < 0)
+		{
+			// nothing in the cache is useful anymore, fall back to the best remaining triangle
+			float bestScore = -1.0f;
+			while (scanCursor < triangleCount && emitted[scanCursor])
+			{
+				scanCursor++;
+			}
+			for (size_t t = scanCursor; t < triangleCount; t++)
+			{
+				if (!emitted[t] && triangleScores[t] > bestScore)
+				{
+					bestScore = triangleScores[t];
+					bestTriangle = (long long)t;
+				}
+			}
+		}
+
+		unsigned int triangle = (unsigned int)bestTriangle;
+		emitted[triangle] = true;
+		const unsigned int *corners = &indices[triangle * 3];
+		output.insert(output.end(), corners, corners + 3);
+
+		// move the triangle's vertices to the front of the cache
+		nextCache.assign(corners, corners + 3);
+		for (unsigned int vertex : cache)
+		{
+			if (vertex != corners[0] && vertex != corners[1] && vertex != corners[2])
+			{
+				nextCache.push_back(vertex);
+			}
+		}
+		cache.swap(nextCache);
+
+		for (int c = 0; c < 3; c++)
+		{
+			// drop the emitted triangle from its vertices' adjacency
+			unsigned int vertex = corners[c];
+			unsigned int *begin = &adjacency[adjacencyOffsets[vertex]];
+			unsigned int *end = begin + remaining[vertex];
+			unsigned int *found = std::find(begin, end, triangle);
+			if (found != end)
+			{
+				std::swap(*found, *(end - 1));
+				remaining[vertex]--;
+			}
+		}
+
+		// rescore every vertex still in (or just evicted from) the cache, then their triangles
+		for (size_t i = 0; i < cache.size(); i++)
+		{
+			unsigned int vertex = cache[i];
+			int position = i < (size_t)FORSYTH_CACHE_SIZE ? (int)i : -1;
+			cachePosition[vertex] = position;
+			scores[vertex] = vertexScore(position, remaining[vertex]);
+		}
+
+		bestTriangle = -1;
+		float bestScore = -1.0f;
+		for (unsigned int vertex : cache)
+		{
+			unsigned int first = adjacencyOffsets[vertex];
+			for (unsigned int a = 0; a < remaining[vertex]; a++)
+			{
+				unsigned int t = adjacency[first + a];
+				float score = scores[indices[t * 3]] + scores[indices[t * 3 + 1]] + scores[indices[t * 3 + 2]];
+				triangleScores[t] = score;
+				if (score > bestScore)
+				{
+					bestScore = score;
+					bestTriangle = t;
+				}
+			}
+		}
+
+		if (cache.size() > (size_t)FORSYTH_CACHE_SIZE)
+		{
+			cache.resize(FORSYTH_CACHE_SIZE);
+		}
+	}
+
+	indices.swap(output);
+}
+
+void OptimizeOverdraw(std::vector<unsigned int> &indices, const std::vector<Vertex> &vertices)
+{
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0)
+	{
+		return;
+	}
+
+	// split wherever a triangle misses the cache with all three vertices, reordering there costs nothing
+	std::vector<size_t> clusterStarts;
+	std::vector<unsigned int> fifo(VERTEX_CACHE_SIZE, 0xffffffffu);
+	size_t fifoHead = 0;
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		int misses = 0;
+		for (int c = 0; c < 3; c++)
+		{
+			unsigned int vertex = indices[t * 3 + c];
+			if (std::find(fifo.begin(), fifo.end(), vertex) == fifo.end())
+			{
+				fifo[fifoHead] = vertex;
+				fifoHead = (fifoHead + 1) % fifo.size();
+				misses++;
+			}
+		}
+		if (misses == 3 || t == 0)
+		{
+			clusterStarts.push_back(t);
+		}
+	}
+	clusterStarts.push_back(triangleCount);
+
+	glm::vec3 meshCentroid(0.0f);
+	for (const Vertex &vertex : vertices)
+	{
+		meshCentroid += vertex.Position;
+	}
+	meshCentroid = meshCentroid / (float)std::max<size_t>(vertices.size(), 1);
+
+	// clusters pointing away from the centre are likely to occlude the rest, draw those first
+	struct Cluster {
+		size_t first;
+		size_t end;
+		float sortKey;
+	};
+	std::vector<Cluster> clusters;
+	clusters.reserve(clusterStarts.size() - 1);
+	for (size_t c = 0; c + 1 < clusterStarts.size(); c++)
+	{
+		glm::vec3 centroid(0.0f);
+		glm::vec3 normal(0.0f);
+		float area = 0.0f;
+		for (size_t t = clusterStarts[c]; t < clusterStarts[c + 1]; t++)
+		{
+			const glm::vec3 &a = vertices[indices[t * 3]].Position;
+			const glm::vec3 &b = vertices[indices[t * 3 + 1]].Position;
+			const glm::vec3 &d = vertices[indices[t * 3 + 2]].Position;
+			glm::vec3 weightedNormal = glm::cross(b - a, d - a);
+			float triangleArea = glm::length(weightedNormal);
+			centroid += (a + b + d) * (triangleArea / 3.0f);
+			normal += weightedNormal;
+			area += triangleArea;
+		}
+
+		Cluster cluster;
+		cluster.first = clusterStarts[c];
+		cluster.end = clusterStarts[c + 1];
+		cluster.sortKey = 0.0f;
+		float normalLength = glm::length(normal);
+		if (area > 0.0f && normalLength > 0.0f)
+		{
+			centroid = centroid / area;
+			cluster.sortKey = glm::dot(centroid - meshCentroid, normal / normalLength);
+		}
+		clusters.push_back(cluster);
+	}
+
+	std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster &a, const Cluster &b) {
+		return a.sortKey > b.sortKey;
+	});
+
+	std::vector<unsigned int> output;
+	output.reserve(indices.size());
+	for (const Cluster &cluster : clusters)
+	{
+		output.insert(output.end(), indices.begin() + cluster.first * 3, indices.begin() + cluster.end * 3);
+	}
+	indices.swap(output);
+}
+
+void OptimizeVertexFetch(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices)
+{
+	const unsigned int unused = 0xffffffffu;
+	std::vector<unsigned int> remap(vertices.size(), unused);
+	std::vector<Vertex> ordered;
+	ordered.reserve(vertices.size());
+
+	for (unsigned int &index : indices)
+	{
+		if (remap[index] == unused)
+		{
+			remap[index] = (unsigned int)ordered.size();
+			ordered.push_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+	vertices.swap(ordered);
+}
+
+std::vector<MeshPart> SplitMesh(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices, size_t maxVertices)
+{
+	std::vector<MeshPart> parts;
+	if (indices.empty() || maxVertices < 3)
+	{
+		return parts;
+	}
+
+	// remap[v] is only valid while owner[v] matches the current part
+	std::vector<unsigned int> remap(vertices.size());
+	std::vector<size_t> owner(vertices.size(), (size_t)-1);
+	parts.emplace_back();
+
+	for (size_t t = 0; t + 2 < indices.size(); t += 3)
+	{
+		size_t current = parts.size() - 1;
+		size_t added = 0;
+		for (int c = 0; c < 3; c++)
+		{
+			if (owner[indices[t + c]] != current)
+			{
+				added++;
+			}
+		}
+
+		if (parts.back().vertices.size() + added > maxVertices - 1)
+		{
+			parts.emplace_back();
+			current++;
+		}
+
+		MeshPart &part = parts.back();
+		for (int c = 0; c < 3; c++)
+		{
+			unsigned int vertex = indices[t + c];
+			if (owner[vertex] != current)
+			{
+				owner[vertex] = current;
+				remap[vertex] = (unsigned int)part.vertices.size();
+				part.vertices.push_back(vertices[vertex]);
+			}
+			part.indices.push_back(remap[vertex]);
+		}
+	}
+	return parts;
+}
+
+float ComputeACMR(const std::vector<unsigned int> &indices, size_t vertexCount, unsigned int cacheSize)
+{
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0)
+	{
+		return 0.0f;
+	}
+
+	// timestamps instead of a real queue: a vertex is cached if it was inserted less than cacheSize misses ago
+	std::vector<size_t> insertedAt(vertexCount, 0);
+	size_t misses = 0;
+	for (unsigned int index : indices)
+	{
+		if (insertedAt[index] == 0 || misses - insertedAt[index] >= cacheSize)
+		{
+			misses++;
+			insertedAt[index] = misses;
+		}
+	}
+	return (float)misses / (float)triangleCount;
+}
+
+// symmetric 4x4 error quadric of Garland and Heckbert, the sum of squared distances to a set of planes
+struct Quadric {
+	double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+};
+
+static void addPlane(Quadric &q, const glm::vec3 &normal, float d)
+{
+	double a = normal.x, b = normal.y, c = normal.z;
+	q.a2 += a * a; q.ab += a * b; q.ac += a * c; q.ad += a * d;
+	q.b2 += b * b; q.bc += b * c; q.bd += b * d;
+	q.c2 += c * c; q.cd += c * d;
+	q.d2 += (double)d * d;
+}
+
+static void addQuadric(Quadric &q, const Quadric &other)
+{
+	q.a2 += other.a2; q.ab += other.ab; q.ac += other.ac; q.ad += other.ad;
+	q.b2 += other.b2; q.bc += other.bc; q.bd += other.bd;
+	q.c2 += other.c2; q.cd += other.cd;
+	q.d2 += other.d2;
+}
+
+static double quadricError(const Quadric &q, const glm::vec3 &p)
+{
+	double x = p.x, y = p.y, z = p.z;
+	double error = q.a2 * x * x + 2.0 * q.ab * x * y + 2.0 * q.ac * x * z + 2.0 * q.ad * x
+		+ q.b2 * y * y + 2.0 * q.bc * y * z + 2.0 * q.bd * y
+		+ q.c2 * z * z + 2.0 * q.cd * z
+		+ q.d2;
+	return error > 0.0 ? error : 0.0;
+}
+
+struct PositionHash {
+	size_t operator()(const glm::vec3 &position) const
+	{
+		unsigned int bits[3];
+		std::memcpy(bits, &position, sizeof(bits));
+		return (size_t)(bits[0] * 73856093u ^ bits[1] * 19349663u ^ bits[2] * 83492791u);
+	}
+};
+
+struct PositionEqual {
+	bool operator()(const glm::vec3 &a, const glm::vec3 &b) const
+	{
+		return a.x == b.x && a.y == b.y && a.z == b.z;
+	}
+};
+
+// true when moving vertex from onto to turns any remaining triangle around from upside down
+static bool collapseFlips(unsigned int from, unsigned int to, const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices,
+	const std::vector<unsigned int> &adjacencyOffsets, const std::vector<unsigned int> &adjacency)
+{
+	for (unsigned int i = adjacencyOffsets[from]; i < adjacencyOffsets[from + 1]; i++)
+	{
+		const unsigned int *triangle = &indices[adjacency[i] * 3];
+		if (triangle[0] == to || triangle[1] == to || triangle[2] == to)
+		{
+			continue; // collapses into a degenerate triangle and disappears
+		}
+		glm::vec3 corners[3], moved[3];
+		for (int corner = 0; corner < 3; corner++)
+		{
+			corners[corner] = vertices[triangle[corner]].Position;
+			moved[corner] = triangle[corner] == from ? vertices[to].Position : corners[corner];
+		}
+		glm::vec3 before = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+		glm::vec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+		if (glm::dot(before, after) <= 0.0f)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+std::vector<unsigned int> SimplifyMesh(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices,
+	size_t targetIndexCount, float &error)
+{
+	std::vector<unsigned int> result(indices);
+	error = 0.0f;
+	size_t vertexCount = vertices.size();
+	if (result.size() <= targetIndexCount || vertexCount == 0)
+	{
+		return result;
+	}
+
+	// vertices sharing a position with another one sit on an attribute seam, moving them would tear it open
+	std::vector<unsigned int> positionIds(vertexCount);
+	std::vector<unsigned int> positionUses;
+	{
+		std::unordered_map<glm::vec3, unsigned int, PositionHash, PositionEqual> positionLookup;
+		positionLookup.reserve(vertexCount);
+		for (size_t v = 0; v < vertexCount; v++)
+		{
+			auto inserted = positionLookup.insert(std::make_pair(vertices[v].Position, (unsigned int)positionUses.size()));
+			if (inserted.second)
+			{
+				positionUses.push_back(0);
+			}
+			positionIds[v] = inserted.first->second;
+			positionUses[positionIds[v]]++;
+		}
+	}
+	std::vector<unsigned char> locked(vertexCount, 0);
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		locked[v] = positionUses[positionIds[v]] > 1;
+	}
+
+	// open borders stay where they are too, an edge used by one triangle only is a border
+	std::vector<uint64_t> edges;
+	edges.reserve(result.size());
+	for (size_t i = 0; i < result.size(); i += 3)
+	{
+		for (int e = 0; e < 3; e++)
+		{
+			unsigned int a = positionIds[result[i + e]], b = positionIds[result[i + (e + 1) % 3]];
+			edges.push_back(((uint64_t)std::min(a, b) << 32) | std::max(a, b));
+		}
+	}
+	std::sort(edges.begin(), edges.end());
+	std::vector<unsigned char> borderPosition(positionUses.size(), 0);
+	for (size_t i = 0; i < edges.size();)
+	{
+		size_t j = i + 1;
+		while (j < edges.size() && edges[j] == edges[i])
+		{
+			j++;
+		}
+		if (j - i == 1)
+		{
+			borderPosition[(size_t)(edges[i] >> 32)] = 1;
+			borderPosition[(size_t)(edges[i] & 0xffffffffu)] = 1;
+		}
+		i = j;
+	}
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		locked[v] |= borderPosition[positionIds[v]];
+	}
+
+	std::vector<Quadric> quadrics(vertexCount, Quadric());
+	for (size_t i = 0; i < result.size(); i += 3)
+	{
+		const glm::vec3 &a = vertices[result[i]].Position;
+		glm::vec3 normal = glm::cross(vertices[result[i + 1]].Position - a, vertices[result[i + 2]].Position - a);
+		float length = glm::length(normal);
+		if (length <= 0.0f)
+		{
+			continue;
+		}
+		normal = normal / length;
+		float d = -glm::dot(normal, a);
+		for (int corner = 0; corner < 3; corner++)
+		{
+			addPlane(quadrics[result[i + corner]], normal, d);
+		}
+	}
+
+	struct Collapse {
+		unsigned int from, to;
+		double cost;
+	};
+	std::vector<Collapse> collapses;
+	std::vector<unsigned int> remap(vertexCount);
+	std::vector<unsigned char> touched(vertexCount);
+	std::vector<unsigned int> adjacencyOffsets(vertexCount + 1);
+	std::vector<unsigned int> adjacency;
+	double maxCost = 0.0;
+
+	// every pass collapses the cheapest independent edges, then compacts the index buffer
+	for (int pass = 0; pass < 64 && result.size() > targetIndexCount; pass++)
+	{
+		size_t triangleCount = result.size() / 3;
+
+		std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+		for (unsigned int index : result)
+		{
+			adjacencyOffsets[index + 1]++;
+		}
+		for (size_t v = 0; v < vertexCount; v++)
+		{
+			adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+		}
+		adjacency.resize(result.size());
+		std::vector<unsigned int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (size_t i = 0; i < result.size(); i++)
+		{
+			adjacency[fill[result[i]]++] = (unsigned int)(i / 3);
+		}
+
+		collapses.clear();
+		for (size_t i = 0; i < result.size(); i += 3)
+		{
+			for (int e = 0; e < 3; e++)
+			{
+				unsigned int a = result[i + e], b = result[i + (e + 1) % 3];
+				if (a > b)
+				{
+					continue; // every interior edge shows up once in each direction
+				}
+				Quadric combined = quadrics[a];
+				addQuadric(combined, quadrics[b]);
+				Collapse collapse;
+				collapse.cost = -1.0;
+				if (!locked[a])
+				{
+					collapse.from = a;
+					collapse.to = b;
+					collapse.cost = quadricError(combined, vertices[b].Position);
+				}
+				if (!locked[b])
+				{
+					double cost = quadricError(combined, vertices[a].Position);
+					if (collapse.cost < 0.0 || cost < collapse.cost)
+					{
+						collapse.from = b;
+						collapse.to = a;
+						collapse.cost = cost;
+					}
+				}
+				if (collapse.cost >= 0.0)
+				{
+					collapses.push_back(collapse);
+				}
+			}
+		}
+		if (collapses.empty())
+		{
+			break;
+		}
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse &x, const Collapse &y) {
+			return x.cost < y.cost;
+		});
+
+		// a collapse removes about two triangles, don't overshoot the target
+		size_t collapsesWanted = (triangleCount - targetIndexCount / 3) / 2 + 1;
+		for (size_t v = 0; v < vertexCount; v++)
+		{
+			remap[v] = (unsigned int)v;
+		}
+		std::fill(touched.begin(), touched.end(), 0);
+		size_t collapsed = 0;
+		for (const Collapse &collapse : collapses)
+		{
+			if (collapsed >= collapsesWanted)
+			{
+				break;
+			}
+			if (touched[collapse.from] || touched[collapse.to]
+				|| collapseFlips(collapse.from, collapse.to, vertices, result, adjacencyOffsets, adjacency))
+			{
+				continue;
+			}
+			remap[collapse.from] = collapse.to;
+			touched[collapse.from] = touched[collapse.to] = 1;
+			addQuadric(quadrics[collapse.to], quadrics[collapse.from]);
+			maxCost = std::max(maxCost, collapse.cost);
+			collapsed++;
+		}
+		if (collapsed == 0)
+		{
+			break;
+		}
+
+		size_t write = 0;
+		for (size_t i = 0; i < result.size(); i += 3)
+		{
+			unsigned int a = remap[result[i]], b = remap[result[i + 1]], c = remap[result[i + 2]];
+			if (a != b && b != c && a != c)
+			{
+				result[write++] = a;
+				result[write++] = b;
+				result[write++] = c;
+			}
+		}
+		result.resize(write);
+	}
+
+	error = (float)std::sqrt(maxCost);
+	return result;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "Vertex.h"
+
+#include <vector>
+
+// Import time passes that make indexed triangle lists friendlier to the GPU. Run them in this order:
+// weld, vertex cache, (overdraw), vertex fetch. Every pass keeps the triangles themselves intact.
+
+// size of the FIFO cache ComputeACMR simulates, a reasonable stand-in for current hardware
+const unsigned int VERTEX_CACHE_SIZE = 16;
+
+// merge vertices whose attributes are bit for bit identical, returns the number of vertices removed
+size_t WeldVertices(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices);
+
+// reorder triangles for post-transform cache locality (Forsyth's linear speed optimizer)
+void OptimizeVertexCache(std::vector<unsigned int> &indices, size_t vertexCount);
+
+// reorder clusters of triangles so the ones facing outwards are drawn first (after Sander et al., "Tipsify").
+// clusters are only split where the vertex cache is cold anyway, so the cache order is mostly preserved
+void OptimizeOverdraw(std::vector<unsigned int> &indices, const std::vector<Vertex> &vertices);
+
+// reorder vertices in the order the index buffer first touches them, drops unreferenced vertices
+void OptimizeVertexFetch(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices);
+
+// one piece of a split mesh
+struct MeshPart {
+	std::vector<Vertex> vertices;
+	std::vector<unsigned int> indices;
+};
+
+// split into parts that each reference fewer than maxVertices vertices, e.g. so every part fits 16 bit indices.
+// triangles keep their order, so an optimized index buffer stays optimized within each part
+std::vector<MeshPart> SplitMesh(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices, size_t maxVertices);
+
+// quadric error edge collapse (Garland and Heckbert) down to about targetIndexCount indices. vertices are only
+// ever collapsed onto other existing vertices, so the result indexes the same vertex buffer and can be stored
+// next to the full index buffer as a lower level of detail. attribute seams and open borders are kept intact,
+// so meshes made of many small open pieces may stop short of the target.
+// error receives the largest collapse error, roughly the distance the surface moved in object space
+std::vector<unsigned int> SimplifyMesh(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices,
+	size_t targetIndexCount, float &error);
+
+// average cache miss ratio: transformed vertices per triangle for a FIFO cache of cacheSize entries
+float ComputeACMR(const std::vector<unsigned int> &indices, size_t vertexCount, unsigned int cacheSize = VERTEX_CACHE_SIZE);
@@ -1,84 +1,455 @@
 #include "Model.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "ThreadPool.h"
+#include "TextureStreamer.h"
 
-unsigned int TextureFromFile(const char *path, const std::string &directory, bool gamma)
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
+/*Model::Model(std::string const &path, bool gamma = false)
 {
-	std::string filename = std::string(path);
-	filename = directory + "/" + filename;
+	loadModel(path);
+}*/
 
-	unsigned int textureID;
-	glGenTextures(1, &textureID);
-	
-	int width, height, nrComponents;
-	unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-	if (data)
+
+Model::~Model()
+{
+	Release();
+}
+
+Model::Model(Model &&other)
+	: textures_loaded(std::move(other.textures_loaded)), meshes(std::move(other.meshes)),
+	arenas(std::move(other.arenas)), batch(std::move(other.batch)), instances(std::move(other.instances)),
+	directory(std::move(other.directory)), options(other.options)
+{
+	// the references moved with the vector, make sure the other destructor doesn't return them as well
+	other.textures_loaded.clear();
+}
+
+Model& Model::operator=(Model &&other)
+{
+	if (this != &other)
+	{
+		Release();
+		textures_loaded = std::move(other.textures_loaded);
+		other.textures_loaded.clear();
+		meshes = std::move(other.meshes);
+		arenas = std::move(other.arenas);
+		batch = std::move(other.batch);
+		instances = std::move(other.instances);
+		directory = std::move(other.directory);
+		options = other.options;
+	}
+	return *this;
+}
+
+void Model::Release()
+{
+	for (const Texture &texture : textures_loaded)
 	{
-		GLenum format;
-		if (nrComponents == 1)
+		TextureManager::Shared().Release(texture.id);
+	}
+	textures_loaded.clear();
+}
+
+
+void Model::Draw(const Shader &shader)
+{
+	// meshes are grouped by VAO on upload, so a model with shared geometry binds one or two VAOs in total
+	GLState &state = GLState::Shared();
+	for (unsigned int i = 0; i < meshes.size(); i++)
+	{
+		meshes[i].BindMaterial(shader);
+		state.BindVertexArray(meshes[i].VAO);
+		meshes[i].DrawElements();
+	}
+
+	// always good practice to set everything back to default once configured;
+	state.ActiveTexture(GL_TEXTURE0);
+}
+
+void Model::DrawBatched(const Shader &shader)
+{
+	batch.Draw(meshes, shader);
+}
+
+void Model::DrawInstanced(const Shader &shader, const glm::mat4 *matrices, const glm::vec4 *colors, size_t count, unsigned int lod)
+{
+	if (count == 0)
+	{
+		return;
+	}
+	instances.Upload(matrices, colors, count);
+
+	// switches the vertex shader from the model uniform to the per-instance matrices
+	shader.setBool("instanced", true);
+
+	GLState &state = GLState::Shared();
+	for (unsigned int i = 0; i < meshes.size(); i++)
+	{
+		meshes[i].BindMaterial(shader);
+		instances.Attach(meshes[i].VAO);
+		state.BindVertexArray(meshes[i].VAO);
+		meshes[i].DrawElementsInstanced((GLsizei)count, lod);
+	}
+
+	shader.setBool("instanced", false);
+
+	// always good practice to set everything back to default once configured;
+	state.ActiveTexture(GL_TEXTURE0);
+}
+
+void Model::Submit(RenderQueue &queue, RenderPass pass, const Shader &shader, const glm::mat4 &transform)
+{
+	for (Mesh &mesh : meshes)
+	{
+		queue.Submit(pass, shader, mesh, transform);
+	}
+}
+
+unsigned int Model::AddInstances(SceneBVH &scene, const glm::mat4 &transform)
+{
+	unsigned int first = (unsigned int)scene.InstanceCount();
+	for (Mesh &mesh : meshes)
+	{
+		scene.AddInstance(&mesh, transform);
+	}
+	return first;
+}
+
+AABB Model::Bounds() const
+{
+	if (meshes.empty())
+	{
+		AABB box;
+		box.min = box.max = glm::vec3(0.0f);
+		return box;
+	}
+	AABB box = EmptyAABB();
+	for (const Mesh &mesh : meshes)
+	{
+		GrowAABB(box, mesh.bounds.box);
+	}
+	return box;
+}
+
+ModelLoadHandle Model::LoadAsync(std::string const &path, const ModelOptions &options)
+{
+	std::string source = path;
+	return ModelLoadHandle(ThreadPool::Shared().Submit([source, options]() { return Import(source, options); }), options);
+}
+
+void Model::loadModel(std::string path)
+{
+	upload(Import(path, options));
+}
+
+ModelData Model::Import(std::string const &path, const ModelOptions &options)
+{
+	const unsigned int importFlags = aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
+	unsigned int processFlags = 0;
+	if (options.optimizeMeshes)
+	{
+		processFlags |= MESH_PROCESS_OPTIMIZE;
+		if (options.optimizeOverdraw)
 		{
-			format = GL_RED;
+			processFlags |= MESH_PROCESS_OVERDRAW;
 		}
-		else if (nrComponents == 3)
+	}
+
+	ModelData data;
+	data.directory = path.substr(0, path.find_last_of('/'));
+
+	// warm start: skip assimp entirely when an up to date mesh cache exists
+	if (!loadFromCache(path, importFlags, processFlags, data))
+	{
+		Assimp::Importer importer;
+		const aiScene *scene = importer.ReadFile(path, importFlags);
+
+		if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
 		{
-			format = GL_RGB;
+			std::cout << "ERROR::ASSIMP::" << importer.GetErrorString() << std::endl;
+			return data;
 		}
-		else if (nrComponents == 4)
+
+		// recursive method
+		processNode(scene->mRootNode, scene, data);
+
+		// optimized meshes go into the cache, so the passes only run on a cold start
+		if (processFlags & MESH_PROCESS_OPTIMIZE)
 		{
-			format = GL_RGBA;
+			std::cout << "MESH_OPTIMIZER::" << path << std::endl;
+			optimizeMeshes(data, (processFlags & MESH_PROCESS_OVERDRAW) != 0);
 		}
 
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
+		if (!MeshCache::Write(path, importFlags, processFlags, data.meshes))
+		{
+			std::cout << "WARNING::MESH_CACHE::FAILED_TO_WRITE " << MeshCache::CachePath(path) << std::endl;
+		}
+	}
 
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	if (options.splitLargeMeshes)
+	{
+		splitMeshes(data);
 	}
-	else
+	for (MeshData &mesh : data.meshes)
+	{
+		mesh.bounds = ComputeBounds(mesh.vertices);
+	}
+	if (options.lodLevels > 1)
+	{
+		generateLods(data, options.lodLevels, options.optimizeMeshes);
+	}
+	if (options.vertexFormat == VERTEX_FORMAT_PACKED)
 	{
-		std::cout << "Texture failed to load at path: " << path << std::endl;
+		packVertices(data);
 	}
-	stbi_image_free(data);
-	return textureID;
+	if (!options.streamTextures)
+	{
+		decodeTextures(data, options.gammaCorrection);
+	}
+	return data;
 }
 
-/*Model::Model(std::string const &path, bool gamma = false)
+void Model::splitMeshes(ModelData &data)
 {
-	loadModel(path);
-}*/
+	std::vector<MeshData> meshes;
+	meshes.reserve(data.meshes.size());
+	for (MeshData &mesh : data.meshes)
+	{
+		if (mesh.vertices.size() < MAX_SHORT_INDEX_VERTICES)
+		{
+			meshes.push_back(std::move(mesh));
+			continue;
+		}
+
+		// every part shares the material of the original mesh
+		for (MeshPart &part : SplitMesh(mesh.vertices, mesh.indices, MAX_SHORT_INDEX_VERTICES))
+		{
+			MeshData split;
+			split.vertices = std::move(part.vertices);
+			split.indices = std::move(part.indices);
+			split.textures = mesh.textures;
+			meshes.push_back(std::move(split));
+		}
+	}
+	data.meshes.swap(meshes);
+}
 
+void Model::packVertices(ModelData &data)
+{
+	// the layout is picked per mesh, so one odd mesh doesn't keep the whole model unpacked
+	for (MeshData &mesh : data.meshes)
+	{
+		if (CanPackVertices(mesh.vertices))
+		{
+			mesh.quantization = PackVertices(mesh.vertices, mesh.packedVertices);
+			mesh.format = VERTEX_FORMAT_PACKED;
+		}
+	}
+}
 
-Model::~Model()
+void Model::generateLods(ModelData &data, unsigned int levels, bool optimize)
 {
+	size_t trianglesFull = 0;
+	size_t trianglesCoarsest = 0;
+	for (MeshData &mesh : data.meshes)
+	{
+		trianglesFull += mesh.indices.size() / 3;
+
+		// every level simplifies the one before, so errors add up along the chain
+		const std::vector<unsigned int> *previous = &mesh.indices;
+		float error = 0.0f;
+		for (unsigned int level = 1; level < levels; level++)
+		{
+			float levelError;
+			MeshLod lod;
+			lod.indices = SimplifyMesh(mesh.vertices, *previous, previous->size() / 2, levelError);
+			// seams and borders can stop the simplifier, a level that barely shrinks isn't worth drawing
+			if (lod.indices.empty() || lod.indices.size() > previous->size() * 9 / 10)
+			{
+				break;
+			}
+			if (optimize)
+			{
+				OptimizeVertexCache(lod.indices, mesh.vertices.size());
+			}
+			error += levelError;
+			lod.error = error;
+			mesh.lods.push_back(std::move(lod));
+			previous = &mesh.lods.back().indices;
+		}
+		trianglesCoarsest += previous->size() / 3;
+	}
+
+	if (trianglesFull > 0)
+	{
+		std::cout << "LOD::triangles " << trianglesFull << " -> " << trianglesCoarsest << " at the coarsest level" << std::endl;
+	}
 }
 
+void Model::optimizeMeshes(ModelData &data, bool overdraw)
+{
+	size_t verticesBefore = 0;
+	size_t verticesAfter = 0;
+	size_t triangles = 0;
+	float missesBefore = 0.0f;
+	float missesAfter = 0.0f;
 
-void Model::Draw(Shader shader)
+	for (MeshData &mesh : data.meshes)
+	{
+		size_t triangleCount = mesh.indices.size() / 3;
+		verticesBefore += mesh.vertices.size();
+		missesBefore += ComputeACMR(mesh.indices, mesh.vertices.size()) * triangleCount;
+
+		WeldVertices(mesh.vertices, mesh.indices);
+		OptimizeVertexCache(mesh.indices, mesh.vertices.size());
+		if (overdraw)
+		{
+			OptimizeOverdraw(mesh.indices, mesh.vertices);
+		}
+		OptimizeVertexFetch(mesh.vertices, mesh.indices);
+
+		verticesAfter += mesh.vertices.size();
+		missesAfter += ComputeACMR(mesh.indices, mesh.vertices.size()) * triangleCount;
+		triangles += triangleCount;
+	}
+
+	if (triangles > 0)
+	{
+		std::cout << "  vertices " << verticesBefore << " -> " << verticesAfter
+			<< ", ACMR " << missesBefore / triangles << " -> " << missesAfter / triangles << std::endl;
+	}
+}
+
+bool Model::loadFromCache(const std::string &path, unsigned int importFlags, unsigned int processFlags, ModelData &data)
 {
-	for (unsigned int i = 0; i < meshes.size(); i++)
+	MeshCache cache;
+	if (!cache.Open(path, importFlags, processFlags))
 	{
-		meshes[i].Draw(shader);
+		return false;
 	}
+
+	data.meshes.resize(cache.MeshCount());
+	for (unsigned int i = 0; i < cache.MeshCount(); i++)
+	{
+		CachedMesh cached = cache.GetMesh(i);
+		MeshData &mesh = data.meshes[i];
+
+		mesh.vertices.assign(cached.vertices, cached.vertices + cached.vertexCount);
+		mesh.indices.assign(cached.indices, cached.indices + cached.indexCount);
+		for (const CachedTexture &cachedTexture : cached.textures)
+		{
+			Texture texture;
+			texture.id = 0;
+			texture.type = cachedTexture.type;
+			texture.path = cachedTexture.path;
+			mesh.textures.push_back(texture);
+		}
+	}
+	return true;
 }
 
-void Model::loadModel(std::string path)
+void Model::decodeTextures(ModelData &data, bool gamma)
 {
-	Assimp::Importer importer;
-	const aiScene *scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+	// every texture file is decoded once, no matter how many meshes use it, and not at all
+	// when another model has it resident already
+	TextureManager &manager = TextureManager::Shared();
+	std::unordered_set<std::string> seen;
+	for (const MeshData &mesh : data.meshes)
+	{
+		for (const Texture &texture : mesh.textures)
+		{
+			if (seen.insert(texture.path).second && !manager.Contains(texture.path, data.directory, gamma))
+			{
+				data.images.push_back(DecodeTextureImage(texture.path.c_str(), data.directory));
+			}
+		}
+	}
+}
 
-	if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+void Model::upload(ModelData &&data)
+{
+	directory = data.directory;
+
+	// the manager shares textures with other models, each one used here takes a reference
+	TextureManager &manager = TextureManager::Shared();
+	std::unordered_map<std::string, unsigned int> textureIds;
+	for (const TextureImage &image : data.images)
 	{
-		std::cout << "ERROR::ASSIMP::" << importer.GetErrorString() << std::endl;
-		return;
+		Texture texture;
+		texture.id = manager.Acquire(image, directory, options.gammaCorrection);
+		texture.path = image.path;
+		textures_loaded.push_back(texture);
+		textureIds[texture.path] = texture.id;
 	}
-	directory = path.substr(0, path.find_last_of('/'));
-	
-	// recursive method
-	processNode(scene->mRootNode, scene);
+
+	// keep meshes of the same vertex format (and so the same arena) next to each other, and within that
+	// the ones with the same textures, so DrawBatch can merge them into one bucket
+	std::stable_sort(data.meshes.begin(), data.meshes.end(), [](const MeshData &a, const MeshData &b) {
+		if (a.format != b.format)
+		{
+			return a.format < b.format;
+		}
+		return std::lexicographical_compare(a.textures.begin(), a.textures.end(), b.textures.begin(), b.textures.end(),
+			[](const Texture &x, const Texture &y) { return x.path < y.path; });
+	});
+
+	meshes.reserve(data.meshes.size());
+	for (MeshData &mesh : data.meshes)
+	{
+		// resolve the GL handles of the textures referenced by this mesh
+		for (Texture &texture : mesh.textures)
+		{
+			auto found = textureIds.find(texture.path);
+			if (found == textureIds.end())
+			{
+				// skipped by decodeTextures because it was resident, normally a hit (or decoded now if it was released since).
+				// streamed textures are decoded on the pool and filled in later
+				Texture loaded;
+				loaded.id = options.streamTextures
+					? TextureStreamer::Shared().Request(texture.path, directory, options.gammaCorrection)
+					: manager.Load(texture.path, directory, options.gammaCorrection);
+				loaded.path = texture.path;
+				textures_loaded.push_back(loaded);
+				found = textureIds.insert(std::make_pair(texture.path, loaded.id)).first;
+			}
+			texture.id = found->second;
+		}
+		if (options.sharedGeometry)
+		{
+			GeometryArena &arena = arenaFor(mesh.format);
+			meshes.emplace_back(std::move(mesh), arena, options.residency);
+		}
+		else
+		{
+			meshes.emplace_back(std::move(mesh), options.residency);
+		}
+	}
+
+	for (GeometryArena &arena : arenas)
+	{
+		arena.Upload();
+	}
+	batch.Build(meshes);
+}
+
+GeometryArena &Model::arenaFor(VertexFormat format)
+{
+	for (GeometryArena &arena : arenas)
+	{
+		if (arena.Format() == format)
+		{
+			return arena;
+		}
+	}
+	arenas.emplace_back(format);
+	return arenas.back();
 }
 
-void Model::processNode(aiNode *node, const aiScene *scene)
+void Model::processNode(aiNode *node, const aiScene *scene, ModelData &data)
 {
 	unsigned int i{};
 
@@ -86,21 +457,22 @@ void Model::processNode(aiNode *node, const aiScene *scene)
 	for (i = 0; i < node->mNumMeshes; i++)
 	{
 		aiMesh *mesh = scene->mMeshes[node->mMeshes[i]];
-		meshes.push_back(processMesh(mesh, scene));
+		data.meshes.emplace_back(processMesh(mesh, scene));
 	}
 
 	// then do the same for each ot its children
 	for (i = 0; i < node->mNumChildren; i++)
 	{
-		processNode(node->mChildren[i], scene);
+		processNode(node->mChildren[i], scene, data);
 	}
 }
 
-Mesh Model::processMesh(aiMesh *mesh, const aiScene *scene)
+MeshData Model::processMesh(aiMesh *mesh, const aiScene *scene)
 {
-	std::vector<Vertex> vertices;
-	std::vector<unsigned int> indices;
-	std::vector<Texture> textures;
+	MeshData data;
+	std::vector<Vertex> &vertices = data.vertices;
+	std::vector<unsigned int> &indices = data.indices;
+	std::vector<Texture> &textures = data.textures;
 
 	for (unsigned int i = 0; i < mesh->mNumVertices; i++)
 	{
@@ -144,7 +516,12 @@ Mesh Model::processMesh(aiMesh *mesh, const aiScene *scene)
 			bitangent.x = mesh->mBitangents[i].x;
 			bitangent.y = mesh->mBitangents[i].y;
 			bitangent.z = mesh->mBitangents[i].z;
-
+			vertex.Bitangent = bitangent;
+		}
+		else
+		{
+			vertex.Tangent = glm::vec3(0.0f, 0.0f, 0.0f);
+			vertex.Bitangent = glm::vec3(0.0f, 0.0f, 0.0f);
 		}
 		vertices.push_back(vertex);
 	}
@@ -194,7 +571,7 @@ Mesh Model::processMesh(aiMesh *mesh, const aiScene *scene)
 		// diffuse maps
 		std::vector<Texture> diffuseMaps;
 		Texture texture;
-		texture.id = TextureFromFile("Assets/Textures/matrix.jpg", directory);
+		texture.id = 0;
 		texture.type = aiTextureType_DIFFUSE;
 		texture.path = std::string("Assets/Textures/matrix.jpg");
 		diffuseMaps.push_back(texture);
@@ -202,37 +579,24 @@ Mesh Model::processMesh(aiMesh *mesh, const aiScene *scene)
 		textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
 	}
 
-	return Mesh(vertices, indices, textures);
+	return data;
 }
 
 std::vector<Texture> Model::loadMaterialTextures(aiMaterial *mat, aiTextureType type, std::string typeName)
 {
+	// only collects the references, the images are decoded once per model in decodeTextures
 	std::vector<Texture> textures;
 	for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
 	{
 		aiString str;
 		mat->GetTexture(type, i, &str);
-		bool skip = false;
-		for (unsigned int j = 0; j < textures_loaded.size(); j++)
-		{
-			if (std::strcmp(textures_loaded[j].path.c_str(), str.C_Str()) == 0)
-			{
-				textures.push_back(textures_loaded[j]);
-				skip = true;
-				break;
-			}
-		}
-		if (!skip)
-		{
-			// if texture hasn't been loaded already, load it
-			Texture texture;
-			texture.id = TextureFromFile(str.C_Str(), directory);
-			texture.type = typeName;
-			texture.path = std::string(str.C_Str());
-			textures.push_back(texture);
 
-		}
+		Texture texture;
+		texture.id = 0;
+		texture.type = typeName;
+		texture.path = std::string(str.C_Str());
+		textures.push_back(texture);
 	}
 
 	return textures;
-}
\ No newline at end of file
+}
@@ -9,44 +9,164 @@
 
 #include "Shader.h"
 #include "Mesh.h"
+#include "DrawBatch.h"
+#include "InstanceBuffer.h"
+#include "RenderQueue.h"
+#include "SceneBVH.h"
+#include "TextureManager.h"
 
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <vector>
+#include <future>
+#include <memory>
 
+// everything a model needs before touching GL, safe to build on any thread
+struct ModelData {
+	std::string directory;
+	std::vector<MeshData> meshes;
+	std::vector<TextureImage> images;
+};
 
+// how a model is imported and what it keeps around after upload
+struct ModelOptions {
+	bool gammaCorrection = false;
+	MeshResidency residency = MESH_KEEP_ALL;
+	// preferred vertex layout, meshes that can't be packed without visible error stay full
+	VertexFormat vertexFormat = VERTEX_FORMAT_FULL;
+	// weld duplicate vertices and reorder for the post-transform cache and vertex fetch
+	bool optimizeMeshes = false;
+	// also sort triangle clusters front to back from the outside in, only used with optimizeMeshes
+	bool optimizeOverdraw = false;
+	// split meshes with 65536 or more vertices so every part can use 16 bit indices
+	bool splitLargeMeshes = false;
+	// sub-allocate all meshes from one VAO/VBO/EBO per vertex format instead of buffers per mesh
+	bool sharedGeometry = true;
+	// levels of detail per mesh including the full one, each with about half the triangles of the one before
+	unsigned int lodLevels = 1;
+	// hand textures to the TextureStreamer instead of decoding them during import. they show a placeholder
+	// until TextureStreamer::Update uploads them, so only use this when something calls Update every frame
+	bool streamTextures = false;
+};
 
-unsigned int TextureFromFile(const char *path, const std::string &directory, bool gamma = false);
+class ModelLoadHandle;
 
 class Model
 {
 public:
 	/* Functions */
 	Model(std::string const &path, bool gamma = false)
-		: gammaCorrection(gamma)
 	{
+		options.gammaCorrection = gamma;
 		//std::cout << path << std::endl;
 		loadModel(path);
 	}
+	Model(std::string const &path, const ModelOptions &options)
+		: options(options)
+	{
+		loadModel(path);
+	}
+	// upload already imported data, must be called on the GL thread
+	Model(ModelData &&data, const ModelOptions &options = ModelOptions())
+		: options(options)
+	{
+		upload(std::move(data));
+	}
+	// releases the textures still held, see Release()
 	~Model();
 
-	void Draw(Shader shader);
+	// models own their meshes, move them instead of copying. the moved-from model holds no texture references
+	Model(Model &&other);
+	Model& operator=(Model &&other);
+	Model(const Model&) = delete;
+	Model& operator=(const Model&) = delete;
+
+	void Draw(const Shader &shader);
+	// same result as Draw, but meshes sharing buffers and material are submitted with one multi-draw call
+	void DrawBatched(const Shader &shader);
+	// draws count copies in one call per mesh, the shader reads each copy's model matrix (and color, white
+	// without colors) from the instance attributes. all copies share one level of detail, so pick it for the
+	// nearest copy (levels past the last one the meshes have draw the last one)
+	void DrawInstanced(const Shader &shader, const glm::mat4 *matrices, const glm::vec4 *colors, size_t count, unsigned int lod = 0);
+	void DrawInstanced(const Shader &shader, const std::vector<glm::mat4> &matrices, unsigned int lod = 0)
+	{
+		DrawInstanced(shader, matrices.data(), nullptr, matrices.size(), lod);
+	}
+	void DrawInstanced(const Shader &shader, const std::vector<glm::mat4> &matrices, const std::vector<glm::vec4> &colors, unsigned int lod = 0)
+	{
+		DrawInstanced(shader, matrices.data(), colors.size() == matrices.size() ? colors.data() : nullptr, matrices.size(), lod);
+	}
+	// queue every mesh for the next RenderQueue::Flush, the model has to outlive the flush
+	void Submit(RenderQueue &queue, RenderPass pass, const Shader &shader, const glm::mat4 &transform);
+	// places every mesh in the scene, returns the first instance (the rest follow in mesh order)
+	unsigned int AddInstances(SceneBVH &scene, const glm::mat4 &transform);
+	size_t MeshCount() const { return meshes.size(); }
+	// object space bounds of all meshes
+	AABB Bounds() const;
+	// gives the model's textures back to the TextureManager on the GL thread. the destructor does it too,
+	// call it explicitly for models that outlive the context. calling it again does nothing
+	void Release();
+
+	// import (assimp or mesh cache) and decode textures on the shared thread pool,
+	// the GL upload happens when the handle is resolved on the render thread
+	static ModelLoadHandle LoadAsync(std::string const &path, const ModelOptions &options = ModelOptions());
+
+	// CPU only part of loading, doesn't touch GL
+	static ModelData Import(std::string const &path, const ModelOptions &options = ModelOptions());
 
 private:
 	/* Model Data*/
+	// one TextureManager reference each
 	std::vector<Texture> textures_loaded;
 	std::vector<Mesh> meshes;
+	// shared buffers of the meshes, at most one per vertex format
+	std::vector<GeometryArena> arenas;
+	DrawBatch batch;
+	InstanceBuffer instances;
 	std::string directory;
-	bool gammaCorrection;
+	ModelOptions options;
 
 	/* Functions */
 	void loadModel(std::string path);
-	void processNode(aiNode *node, const aiScene *scene);
-	Mesh processMesh(aiMesh *mesh, const aiScene *scene);
-	std::vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type,
+	void upload(ModelData &&data);
+	GeometryArena &arenaFor(VertexFormat format);
+	static bool loadFromCache(const std::string &path, unsigned int importFlags, unsigned int processFlags, ModelData &data);
+	static void processNode(aiNode *node, const aiScene *scene, ModelData &data);
+	static MeshData processMesh(aiMesh *mesh, const aiScene *scene);
+	static std::vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type,
 		std::string typeName);
+	static void optimizeMeshes(ModelData &data, bool overdraw);
+	static void decodeTextures(ModelData &data, bool gamma);
+	static void splitMeshes(ModelData &data);
+	static void packVertices(ModelData &data);
+	static void generateLods(ModelData &data, unsigned int levels, bool optimize);
 
 };
 
+// pending result of Model::LoadAsync
+class ModelLoadHandle
+{
+public:
+	ModelLoadHandle(std::future<ModelData> &&future, const ModelOptions &options)
+		: future(std::move(future)), options(options)
+	{
+	}
+
+	// true once the worker finished importing, Get() won't block anymore
+	bool Ready() const
+	{
+		return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+	}
+
+	// waits for the import and uploads the result, call on the GL thread
+	Model Get()
+	{
+		return Model(future.get(), options);
+	}
+
+private:
+	std::future<ModelData> future;
+	ModelOptions options;
+};
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+// Lock-free multi producer, single consumer queue (Dmitry Vyukov's intrusive node queue).
+// Any thread may Push, only one thread at a time may Pop. T has to be default constructible.
+template<typename T>
+class MpscQueue
+{
+public:
+	MpscQueue()
+		: head(&stub), tail(&stub)
+	{
+		stub.next.store(nullptr, std::memory_order_relaxed);
+	}
+
+	~MpscQueue()
+	{
+		T value;
+		while (Pop(value))
+		{
+		}
+		if (tail != &stub)
+		{
+			delete tail;
+		}
+	}
+
+	MpscQueue(const MpscQueue&) = delete;
+	MpscQueue& operator=(const MpscQueue&) = delete;
+
+	void Push(T value)
+	{
+		Node *node = new Node;
+		node->value = std::move(value);
+		node->next.store(nullptr, std::memory_order_relaxed);
+		// the exchange orders producers, the store publishes the node to the consumer
+		Node *previous = head.exchange(node, std::memory_order_acq_rel);
+		previous->next.store(node, std::memory_order_release);
+	}
+
+	// false when empty, or when a producer is halfway through a push (it shows up on the next call)
+	bool Pop(T &value)
+	{
+		Node *first = tail;
+		Node *next = first->next.load(std::memory_order_acquire);
+		if (!next)
+		{
+			return false;
+		}
+		// next becomes the new dummy node, its value is handed out
+		value = std::move(next->value);
+		tail = next;
+		if (first != &stub)
+		{
+			delete first;
+		}
+		return true;
+	}
+
+private:
+	struct Node {
+		std::atomic<Node*> next;
+		T value;
+	};
+	Node stub;
+	std::atomic<Node*> head;
+	Node *tail;
+};
@@ -0,0 +1,411 @@
+#include "Occlusion.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <future>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define OCCLUSION_SSE
+#endif
+
+// tiles are rasterized independently, so no two workers ever write the same pixel
+static const unsigned int TILE_WIDTH = 64;
+static const unsigned int TILE_HEIGHT = 32;
+static const float EMPTY_DEPTH = 1.0f;
+
+OcclusionCuller::OcclusionCuller(unsigned int width, unsigned int height)
+{
+	tilesX = std::max(1u, (width + TILE_WIDTH - 1) / TILE_WIDTH);
+	tilesY = std::max(1u, (height + TILE_HEIGHT - 1) / TILE_HEIGHT);
+	this->width = tilesX * TILE_WIDTH;
+	this->height = tilesY * TILE_HEIGHT;
+	tileBins.resize(tilesX * tilesY);
+
+	// a few workers are plenty for a buffer this small, leave the rest of the cores to the shared pool
+	unsigned int hardwareThreads = std::thread::hardware_concurrency();
+	pool.reset(new ThreadPool(std::max(1u, std::min(4u, hardwareThreads / 2))));
+
+	// every level halves the one below it, down to a single texel
+	unsigned int levelWidth = this->width, levelHeight = this->height;
+	for (;;)
+	{
+		Level level;
+		level.width = levelWidth;
+		level.height = levelHeight;
+		level.depth.assign(levelWidth * levelHeight, EMPTY_DEPTH);
+		levels.push_back(std::move(level));
+		if (levelWidth == 1 && levelHeight == 1)
+		{
+			break;
+		}
+		levelWidth = std::max(1u, (levelWidth + 1) / 2);
+		levelHeight = std::max(1u, (levelHeight + 1) / 2);
+	}
+	stats = Stats();
+}
+
+void OcclusionCuller::Begin(const glm::mat4 &viewProjection)
+{
+	this->viewProjection = viewProjection;
+	occluders.clear();
+	rasterized = false;
+	stats = Stats();
+}
+
+void OcclusionCuller::AddOccluder(const Mesh &mesh, const glm::mat4 &transform)
+{
+	if (mesh.indices.empty() || (mesh.positions.empty() && mesh.vertices.empty()))
+	{
+		return;
+	}
+	Occluder occluder;
+	occluder.positions = mesh.positions.empty() ? nullptr : &mesh.positions;
+	occluder.vertices = &mesh.vertices;
+	occluder.indices = &mesh.indices;
+	occluder.transform = transform;
+	occluders.push_back(occluder);
+}
+
+void OcclusionCuller::AddOccluder(const std::vector<glm::vec3> &positions, const std::vector<unsigned int> &indices, const glm::mat4 &transform)
+{
+	Occluder occluder;
+	occluder.positions = &positions;
+	occluder.vertices = nullptr;
+	occluder.indices = &indices;
+	occluder.transform = transform;
+	occluders.push_back(occluder);
+}
+
+void OcclusionCuller::setupTriangles(unsigned int occluderIndex)
+{
+	const Occluder &occluder = occluders[occluderIndex];
+	std::vector<ScreenTriangle> &triangles = occluderTriangles[occluderIndex];
+	triangles.clear();
+
+	// transform every vertex once, indexed triangles share them
+	glm::mat4 clipTransform = viewProjection * occluder.transform;
+	size_t vertexCount = occluder.positions ? occluder.positions->size() : occluder.vertices->size();
+	std::vector<glm::vec4> clip(vertexCount);
+	for (size_t i = 0; i < vertexCount; i++)
+	{
+		const glm::vec3 &position = occluder.positions ? (*occluder.positions)[i] : (*occluder.vertices)[i].Position;
+		clip[i] = clipTransform * glm::vec4(position, 1.0f);
+	}
+
+	float screenWidth = (float)width, screenHeight = (float)height;
+	const std::vector<unsigned int> &indices = *occluder.indices;
+	for (size_t i = 0; i + 2 < indices.size(); i += 3)
+	{
+		ScreenTriangle triangle;
+		bool clipped = false;
+		for (int corner = 0; corner < 3; corner++)
+		{
+			const glm::vec4 &c = clip[indices[i + corner]];
+			// triangles crossing the near plane are dropped instead of clipped, an occluder
+			// that covers less is still correct
+			if (c.w <= 0.0f || c.z < -c.w)
+			{
+				clipped = true;
+				break;
+			}
+			float inverseW = 1.0f / c.w;
+			triangle.v[corner] = glm::vec3((c.x * inverseW * 0.5f + 0.5f) * screenWidth,
+				(c.y * inverseW * 0.5f + 0.5f) * screenHeight,
+				c.z * inverseW * 0.5f + 0.5f);
+		}
+		if (clipped)
+		{
+			continue;
+		}
+
+		const glm::vec3 &a = triangle.v[0], &b = triangle.v[1], &c = triangle.v[2];
+		if (std::max(std::max(a.x, b.x), c.x) < 0.0f || std::min(std::min(a.x, b.x), c.x) >= screenWidth
+			|| std::max(std::max(a.y, b.y), c.y) < 0.0f || std::min(std::min(a.y, b.y), c.y) >= screenHeight)
+		{
+			continue;
+		}
+
+		// both faces occlude, counter clockwise order keeps the edge functions positive inside
+		float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+		if (std::fabs(area) < 1e-6f)
+		{
+			continue;
+		}
+		if (area < 0.0f)
+		{
+			std::swap(triangle.v[1], triangle.v[2]);
+		}
+		triangles.push_back(triangle);
+	}
+}
+
+void OcclusionCuller::rasterizeTile(unsigned int tile)
+{
+	std::vector<float> &depth = levels[0].depth;
+	int tileMinX = (int)((tile % tilesX) * TILE_WIDTH);
+	int tileMinY = (int)((tile / tilesX) * TILE_HEIGHT);
+	int tileMaxX = tileMinX + (int)TILE_WIDTH - 1;
+	int tileMaxY = tileMinY + (int)TILE_HEIGHT - 1;
+
+	for (int y = tileMinY; y <= tileMaxY; y++)
+	{
+		std::fill(depth.begin() + y * width + tileMinX, depth.begin() + y * width + tileMaxX + 1, EMPTY_DEPTH);
+	}
+
+	for (uint64_t reference : tileBins[tile])
+	{
+		const ScreenTriangle &triangle = occluderTriangles[(size_t)(reference >> 32)][(size_t)(reference & 0xffffffffu)];
+		const glm::vec3 &v0 = triangle.v[0], &v1 = triangle.v[1], &v2 = triangle.v[2];
+
+		// pixel bounds of the triangle inside this tile, x starts on a multiple of four
+		int minX = std::max(tileMinX, (int)std::floor(std::min(std::min(v0.x, v1.x), v2.x))) & ~3;
+		int maxX = std::min(tileMaxX, (int)std::floor(std::max(std::max(v0.x, v1.x), v2.x)));
+		int minY = std::max(tileMinY, (int)std::floor(std::min(std::min(v0.y, v1.y), v2.y)));
+		int maxY = std::min(tileMaxY, (int)std::floor(std::max(std::max(v0.y, v1.y), v2.y)));
+		if (minX > maxX || minY > maxY)
+		{
+			continue;
+		}
+
+		// edge functions e = a * x + b * y + c, positive inside. each is opposite the vertex it weights
+		float edgeA[3], edgeB[3], edgeC[3];
+		const glm::vec3 *corners[3] = { &v0, &v1, &v2 };
+		for (int e = 0; e < 3; e++)
+		{
+			const glm::vec3 &from = *corners[(e + 1) % 3];
+			const glm::vec3 &to = *corners[(e + 2) % 3];
+			edgeA[e] = from.y - to.y;
+			edgeB[e] = to.x - from.x;
+			edgeC[e] = from.x * to.y - from.y * to.x;
+		}
+		// depth as a plane over the screen, from the barycentric weights
+		float inverseArea = 1.0f / (edgeA[0] * v0.x + edgeB[0] * v0.y + edgeC[0]);
+		float depthA = (edgeA[0] * v0.z + edgeA[1] * v1.z + edgeA[2] * v2.z) * inverseArea;
+		float depthB = (edgeB[0] * v0.z + edgeB[1] * v1.z + edgeB[2] * v2.z) * inverseArea;
+		float depthC = (edgeC[0] * v0.z + edgeC[1] * v1.z + edgeC[2] * v2.z) * inverseArea;
+
+#ifdef OCCLUSION_SSE
+		__m128 columnOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+		__m128 zero = _mm_setzero_ps();
+		for (int y = minY; y <= maxY; y++)
+		{
+			float pixelY = (float)y + 0.5f;
+			float *row = &depth[y * width];
+			for (int x = minX; x <= maxX; x += 4)
+			{
+				__m128 pixelX = _mm_add_ps(_mm_set1_ps((float)x), columnOffsets);
+				__m128 inside = _mm_cmpgt_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(edgeA[0]), pixelX), _mm_set1_ps(edgeB[0] * pixelY + edgeC[0])), zero);
+				inside = _mm_and_ps(inside, _mm_cmpgt_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(edgeA[1]), pixelX), _mm_set1_ps(edgeB[1] * pixelY + edgeC[1])), zero));
+				inside = _mm_and_ps(inside, _mm_cmpgt_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(edgeA[2]), pixelX), _mm_set1_ps(edgeB[2] * pixelY + edgeC[2])), zero));
+				if (!_mm_movemask_ps(inside))
+				{
+					continue;
+				}
+				__m128 pixelDepth = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(depthA), pixelX), _mm_set1_ps(depthB * pixelY + depthC));
+				__m128 stored = _mm_loadu_ps(row + x);
+				__m128 nearer = _mm_min_ps(stored, pixelDepth);
+				_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, stored)));
+			}
+		}
+#else
+		for (int y = minY; y <= maxY; y++)
+		{
+			float pixelY = (float)y + 0.5f;
+			float *row = &depth[y * width];
+			for (int x = minX; x <= maxX; x++)
+			{
+				float pixelX = (float)x + 0.5f;
+				if (edgeA[0] * pixelX + edgeB[0] * pixelY + edgeC[0] > 0.0f
+					&& edgeA[1] * pixelX + edgeB[1] * pixelY + edgeC[1] > 0.0f
+					&& edgeA[2] * pixelX + edgeB[2] * pixelY + edgeC[2] > 0.0f)
+				{
+					row[x] = std::min(row[x], depthA * pixelX + depthB * pixelY + depthC);
+				}
+			}
+		}
+#endif
+	}
+}
+
+void OcclusionCuller::buildPyramid()
+{
+	// every texel holds the farthest depth below it, so a box nearer than a texel is in front of all of it
+	for (size_t i = 1; i < levels.size(); i++)
+	{
+		const Level &below = levels[i - 1];
+		Level &level = levels[i];
+		for (unsigned int y = 0; y < level.height; y++)
+		{
+			unsigned int y0 = std::min(y * 2, below.height - 1), y1 = std::min(y * 2 + 1, below.height - 1);
+			for (unsigned int x = 0; x < level.width; x++)
+			{
+				unsigned int x0 = std::min(x * 2, below.width - 1), x1 = std::min(x * 2 + 1, below.width - 1);
+				level.depth[y * level.width + x] = std::max(
+					std::max(below.depth[y0 * below.width + x0], below.depth[y0 * below.width + x1]),
+					std::max(below.depth[y1 * below.width + x0], below.depth[y1 * below.width + x1]));
+			}
+		}
+	}
+}
+
+void OcclusionCuller::Rasterize()
+{
+	typedef std::chrono::high_resolution_clock Clock;
+	Clock::time_point start = Clock::now();
+	std::vector<std::future<void>> jobs;
+
+	// transform and set up the occluder triangles
+	occluderTriangles.resize(occluders.size());
+	for (unsigned int i = 0; i < occluders.size(); i++)
+	{
+		jobs.push_back(pool->Submit([this, i]() { setupTriangles(i); }));
+	}
+	for (std::future<void> &job : jobs)
+	{
+		job.get();
+	}
+	jobs.clear();
+
+	// bin them into every tile their bounds touch
+	for (std::vector<uint64_t> &bin : tileBins)
+	{
+		bin.clear();
+	}
+	stats.occluders = (unsigned int)occluders.size();
+	stats.triangles = 0;
+	for (size_t o = 0; o < occluderTriangles.size(); o++)
+	{
+		const std::vector<ScreenTriangle> &triangles = occluderTriangles[o];
+		stats.triangles += (unsigned int)triangles.size();
+		for (size_t t = 0; t < triangles.size(); t++)
+		{
+			const glm::vec3 *v = triangles[t].v;
+			float minX = std::min(std::min(v[0].x, v[1].x), v[2].x), maxX = std::max(std::max(v[0].x, v[1].x), v[2].x);
+			float minY = std::min(std::min(v[0].y, v[1].y), v[2].y), maxY = std::max(std::max(v[0].y, v[1].y), v[2].y);
+			int firstTileX = std::max(0, (int)minX / (int)TILE_WIDTH), lastTileX = std::min((int)tilesX - 1, (int)maxX / (int)TILE_WIDTH);
+			int firstTileY = std::max(0, (int)minY / (int)TILE_HEIGHT), lastTileY = std::min((int)tilesY - 1, (int)maxY / (int)TILE_HEIGHT);
+			for (int tileY = firstTileY; tileY <= lastTileY; tileY++)
+			{
+				for (int tileX = firstTileX; tileX <= lastTileX; tileX++)
+				{
+					tileBins[tileY * tilesX + tileX].push_back(((uint64_t)o << 32) | (uint64_t)t);
+				}
+			}
+		}
+	}
+
+	for (unsigned int tile = 0; tile < tileBins.size(); tile++)
+	{
+		jobs.push_back(pool->Submit([this, tile]() { rasterizeTile(tile); }));
+	}
+	for (std::future<void> &job : jobs)
+	{
+		job.get();
+	}
+
+	buildPyramid();
+	rasterized = true;
+	stats.rasterizeMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+bool OcclusionCuller::IsVisible(const AABB &worldBox) const
+{
+	if (!rasterized)
+	{
+		return true;
+	}
+	stats.tested++;
+
+	// screen rectangle and nearest depth of the box corners
+	float minX = std::numeric_limits<float>::max(), minY = minX, minZ = minX;
+	float maxX = -minX, maxY = -minX;
+	for (int corner = 0; corner < 8; corner++)
+	{
+		glm::vec3 position((corner & 1) ? worldBox.max.x : worldBox.min.x,
+			(corner & 2) ? worldBox.max.y : worldBox.min.y,
+			(corner & 4) ? worldBox.max.z : worldBox.min.z);
+		glm::vec4 clip = viewProjection * glm::vec4(position, 1.0f);
+		if (clip.w <= 0.0f || clip.z < -clip.w)
+		{
+			return true;
+		}
+		float inverseW = 1.0f / clip.w;
+		float x = (clip.x * inverseW * 0.5f + 0.5f) * width;
+		float y = (clip.y * inverseW * 0.5f + 0.5f) * height;
+		minX = std::min(minX, x);
+		maxX = std::max(maxX, x);
+		minY = std::min(minY, y);
+		maxY = std::max(maxY, y);
+		minZ = std::min(minZ, clip.z * inverseW * 0.5f + 0.5f);
+	}
+	if (maxX < 0.0f || maxY < 0.0f || minX >= (float)width || minY >= (float)height)
+	{
+		return true; // off screen, that's for frustum culling to decide
+	}
+
+	int x0 = std::max(0, (int)minX), x1 = std::min((int)width - 1, (int)maxX);
+	int y0 = std::max(0, (int)minY), y1 = std::min((int)height - 1, (int)maxY);
+
+	// the level where the rectangle spans at most two texels per axis (three when unaligned)
+	unsigned int levelIndex = 0;
+	int extent = std::max(x1 - x0, y1 - y0);
+	while (extent > 1 && levelIndex + 1 < levels.size())
+	{
+		extent >>= 1;
+		levelIndex++;
+	}
+	const Level &level = levels[levelIndex];
+	x0 = std::min(x0 >> levelIndex, (int)level.width - 1);
+	x1 = std::min(x1 >> levelIndex, (int)level.width - 1);
+	y0 = std::min(y0 >> levelIndex, (int)level.height - 1);
+	y1 = std::min(y1 >> levelIndex, (int)level.height - 1);
+
+	for (int y = y0; y <= y1; y++)
+	{
+		for (int x = x0; x <= x1; x++)
+		{
+			if (minZ <= level.depth[y * level.width + x])
+			{
+				return true;
+			}
+		}
+	}
+	stats.occluded++;
+	return false;
+}
+
+std::vector<unsigned int> SelectOccluders(const SceneBVH &scene, unsigned int maxOccluders, unsigned int maxTriangles)
+{
+	struct Candidate {
+		unsigned int instance;
+		float area;
+	};
+	std::vector<Candidate> candidates;
+	for (unsigned int i = 0; i < scene.InstanceCount(); i++)
+	{
+		const SceneInstance &instance = scene.GetInstance(i);
+		const Mesh &mesh = *instance.mesh;
+		if (mesh.indices.empty() || (mesh.positions.empty() && mesh.vertices.empty()) || mesh.indices.size() / 3 > maxTriangles)
+		{
+			continue;
+		}
+		glm::vec3 size = instance.bounds.max - instance.bounds.min;
+		Candidate candidate;
+		candidate.instance = i;
+		candidate.area = size.x * size.y + size.y * size.z + size.z * size.x;
+		candidates.push_back(candidate);
+	}
+
+	std::sort(candidates.begin(), candidates.end(), [](const Candidate &a, const Candidate &b) {
+		return a.area > b.area;
+	});
+	std::vector<unsigned int> selected;
+	for (size_t i = 0; i < candidates.size() && i < maxOccluders; i++)
+	{
+		selected.push_back(candidates[i].instance);
+	}
+	return selected;
+}
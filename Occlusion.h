@@ -0,0 +1,89 @@
+#pragma once
+#include <glm/glm.hpp>
+
+#include "Mesh.h"
+#include "Culling.h"
+#include "SceneBVH.h"
+#include "ThreadPool.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Occlusion culling on the CPU. A few large occluders are rasterized into a small depth buffer by
+// its own worker threads (one job per screen tile, four pixels at a time with SSE), a max-depth pyramid
+// is built from it and boxes are tested against the pyramid level where they cover about 2x2 texels.
+// Nothing touches GL, so it runs anywhere.
+class OcclusionCuller
+{
+public:
+	/* Functions */
+	// buffer size in pixels, rounded up to whole tiles
+	explicit OcclusionCuller(unsigned int width = 256, unsigned int height = 128);
+
+	// starts a frame, pass projection * view
+	void Begin(const glm::mat4 &viewProjection);
+	// the geometry is read during Rasterize(), so it has to stay alive until then.
+	// meshes without positions and indices on the CPU are ignored
+	void AddOccluder(const Mesh &mesh, const glm::mat4 &transform);
+	void AddOccluder(const std::vector<glm::vec3> &positions, const std::vector<unsigned int> &indices, const glm::mat4 &transform);
+	// rasterizes the occluders and builds the depth pyramid, blocks until the workers are done
+	void Rasterize();
+
+	// false when the box is hidden behind the occluders. boxes crossing the near plane are always visible
+	bool IsVisible(const AABB &worldBox) const;
+
+	unsigned int Width() const { return width; }
+	unsigned int Height() const { return height; }
+	// rasterized depth (NDC z mapped to [0, 1], 1 is empty), row major from the bottom row
+	const std::vector<float> &DepthBuffer() const { return levels[0].depth; }
+
+	// work done in the current frame
+	struct Stats {
+		unsigned int occluders;
+		unsigned int triangles;		// after dropping off screen, degenerate and near plane crossing ones
+		unsigned int tested;
+		unsigned int occluded;
+		double rasterizeMilliseconds;
+	};
+	const Stats &GetStats() const { return stats; }
+
+private:
+	/* Occlusion Data */
+	struct Occluder {
+		const std::vector<glm::vec3> *positions;
+		const std::vector<Vertex> *vertices;	// used when there are no positions
+		const std::vector<unsigned int> *indices;
+		glm::mat4 transform;
+	};
+	// screen space triangle, x and y in pixels, z in [0, 1]
+	struct ScreenTriangle {
+		glm::vec3 v[3];
+	};
+	struct Level {
+		unsigned int width, height;
+		std::vector<float> depth;
+	};
+	unsigned int width, height;
+	unsigned int tilesX, tilesY;
+	glm::mat4 viewProjection;
+	bool rasterized = false;
+	std::vector<Occluder> occluders;
+	// triangles of each occluder, filled by the workers
+	std::vector<std::vector<ScreenTriangle>> occluderTriangles;
+	// triangle references per tile, (occluder << 32 | triangle)
+	std::vector<std::vector<uint64_t>> tileBins;
+	std::vector<Level> levels;
+	mutable Stats stats;
+	// not the shared pool, the frame waits for these jobs and mustn't queue behind decodes and bakes
+	std::unique_ptr<ThreadPool> pool;
+
+	/* Functions */
+	void setupTriangles(unsigned int occluder);
+	void rasterizeTile(unsigned int tile);
+	void buildPyramid();
+};
+
+// picks up to maxOccluders instances that make good occluders: large boxes with few triangles,
+// from meshes that keep their positions and indices on the CPU
+std::vector<unsigned int> SelectOccluders(const SceneBVH &scene, unsigned int maxOccluders, unsigned int maxTriangles);
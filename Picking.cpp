@@ -0,0 +1,372 @@
+#include "Picking.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PICKING_SSE
+#endif
+
+static const int SAH_BINS = 8;
+static const unsigned int LEAF_TRIANGLES = 4;
+// rays nearly parallel to a triangle's plane miss it
+static const float DETERMINANT_EPSILON = 1e-12f;
+
+Ray CameraRay(const Camera &camera, float cursorX, float cursorY, float width, float height)
+{
+	// same field of view and aspect as the projection in Main
+	float tanHalfFov = std::tan(glm::radians(camera.Zoom) * 0.5f);
+	float x = (2.0f * cursorX / width - 1.0f) * tanHalfFov * (width / height);
+	float y = (1.0f - 2.0f * cursorY / height) * tanHalfFov;
+
+	Ray ray;
+	ray.origin = camera.Position;
+	ray.direction = glm::normalize(camera.Front + camera.Right * x + camera.Up * y);
+	return ray;
+}
+
+void TriangleBVH::Build(const std::vector<glm::vec3> &positions, const std::vector<unsigned int> &indices)
+{
+	nodes.clear();
+	packets.clear();
+	depth = 0;
+	unsigned int triangleCount = (unsigned int)(indices.size() / 3);
+	if (triangleCount == 0)
+	{
+		return;
+	}
+
+	std::vector<AABB> boxes(triangleCount);
+	std::vector<unsigned int> order(triangleCount);
+	for (unsigned int i = 0; i < triangleCount; i++)
+	{
+		const glm::vec3 &a = positions[indices[i * 3]];
+		const glm::vec3 &b = positions[indices[i * 3 + 1]];
+		const glm::vec3 &c = positions[indices[i * 3 + 2]];
+		boxes[i].min = glm::min(a, glm::min(b, c));
+		boxes[i].max = glm::max(a, glm::max(b, c));
+		order[i] = i;
+	}
+
+	// at most one leaf per triangle, so references stay valid while building
+	nodes.reserve(triangleCount * 2);
+	packets.reserve((triangleCount + LEAF_TRIANGLES - 1) / LEAF_TRIANGLES * 2);
+	Node root;
+	root.bounds = EmptyAABB();
+	for (const AABB &box : boxes)
+	{
+		GrowAABB(root.bounds, box);
+	}
+	root.leftFirst = 0;
+	root.count = triangleCount;
+	nodes.push_back(root);
+	subdivide(0, 0, order, boxes, positions, indices);
+}
+
+void TriangleBVH::subdivide(unsigned int nodeIndex, unsigned int nodeDepth, std::vector<unsigned int> &order, const std::vector<AABB> &boxes,
+	const std::vector<glm::vec3> &positions, const std::vector<unsigned int> &indices)
+{
+	// while building, count is the number of triangles starting at leftFirst in order
+	Node &node = nodes[nodeIndex];
+	unsigned int first = node.leftFirst;
+	unsigned int count = node.count;
+	depth = std::max(depth, nodeDepth);
+
+	if (count <= LEAF_TRIANGLES)
+	{
+		TrianglePacket packet = {};
+		for (unsigned int lane = 0; lane < LEAF_TRIANGLES; lane++)
+		{
+			// padding lanes repeat the last triangle with zero edges, which the determinant test rejects
+			unsigned int triangle = order[first + std::min(lane, count - 1)];
+			glm::vec3 a = positions[indices[triangle * 3]];
+			glm::vec3 edge1 = positions[indices[triangle * 3 + 1]] - a;
+			glm::vec3 edge2 = positions[indices[triangle * 3 + 2]] - a;
+			if (lane >= count)
+			{
+				edge1 = edge2 = glm::vec3(0.0f);
+			}
+			for (int axis = 0; axis < 3; axis++)
+			{
+				packet.v0[axis][lane] = a[axis];
+				packet.edge1[axis][lane] = edge1[axis];
+				packet.edge2[axis][lane] = edge2[axis];
+			}
+			packet.triangle[lane] = triangle;
+		}
+		node.leftFirst = (unsigned int)packets.size();
+		node.count = 1;
+		packets.push_back(packet);
+		return;
+	}
+
+	// binned SAH, leaves are always small so there's no leaf cost to beat
+	SAHSplit split = FindSAHSplit(count, SAH_BINS, [&](unsigned int i) -> const AABB& {
+		return boxes[order[first + i]];
+	});
+
+	unsigned int leftCount;
+	if (split.axis >= 0)
+	{
+		unsigned int *begin = &order[first];
+		unsigned int *middle = std::partition(begin, begin + count, [&](unsigned int triangle) {
+			return split.IsLeft(AABBCenter(boxes[triangle]));
+		});
+		leftCount = (unsigned int)(middle - begin);
+	}
+	else
+	{
+		// every centroid in the same spot, any split is as good as another
+		leftCount = count / 2;
+	}
+
+	unsigned int leftIndex = (unsigned int)nodes.size();
+	Node children[2];
+	children[0].leftFirst = first;
+	children[0].count = leftCount;
+	children[1].leftFirst = first + leftCount;
+	children[1].count = count - leftCount;
+	for (Node &child : children)
+	{
+		child.bounds = EmptyAABB();
+		for (unsigned int i = 0; i < child.count; i++)
+		{
+			GrowAABB(child.bounds, boxes[order[child.leftFirst + i]]);
+		}
+		nodes.push_back(child);
+	}
+
+	node.leftFirst = leftIndex;
+	node.count = 0;
+	subdivide(leftIndex, nodeDepth + 1, order, boxes, positions, indices);
+	subdivide(leftIndex + 1, nodeDepth + 1, order, boxes, positions, indices);
+}
+
+// Moller-Trumbore against the four triangles of a packet
+bool TriangleBVH::intersectPacket(const TrianglePacket &packet, const Ray &ray, float &nearest, TriangleHit &hit) const
+{
+#ifdef PICKING_SSE
+	__m128 v0x = _mm_loadu_ps(packet.v0[0]), v0y = _mm_loadu_ps(packet.v0[1]), v0z = _mm_loadu_ps(packet.v0[2]);
+	__m128 e1x = _mm_loadu_ps(packet.edge1[0]), e1y = _mm_loadu_ps(packet.edge1[1]), e1z = _mm_loadu_ps(packet.edge1[2]);
+	__m128 e2x = _mm_loadu_ps(packet.edge2[0]), e2y = _mm_loadu_ps(packet.edge2[1]), e2z = _mm_loadu_ps(packet.edge2[2]);
+	__m128 dx = _mm_set1_ps(ray.direction.x), dy = _mm_set1_ps(ray.direction.y), dz = _mm_set1_ps(ray.direction.z);
+
+	// p = direction x edge2
+	__m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+	__m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+	__m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+	__m128 determinant = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+	__m128 absDeterminant = _mm_andnot_ps(_mm_set1_ps(-0.0f), determinant);
+	__m128 valid = _mm_cmpgt_ps(absDeterminant, _mm_set1_ps(DETERMINANT_EPSILON));
+	if (!_mm_movemask_ps(valid))
+	{
+		return false;
+	}
+	__m128 inverseDeterminant = _mm_div_ps(_mm_set1_ps(1.0f), determinant);
+
+	__m128 sx = _mm_sub_ps(_mm_set1_ps(ray.origin.x), v0x);
+	__m128 sy = _mm_sub_ps(_mm_set1_ps(ray.origin.y), v0y);
+	__m128 sz = _mm_sub_ps(_mm_set1_ps(ray.origin.z), v0z);
+	__m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), inverseDeterminant);
+
+	// q = s x edge1
+	__m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+	__m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+	__m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+	__m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inverseDeterminant);
+	__m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inverseDeterminant);
+
+	__m128 zero = _mm_setzero_ps();
+	valid = _mm_and_ps(valid, _mm_cmpge_ps(u, zero));
+	valid = _mm_and_ps(valid, _mm_cmpge_ps(v, zero));
+	valid = _mm_and_ps(valid, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0f)));
+	valid = _mm_and_ps(valid, _mm_cmpgt_ps(t, zero));
+	valid = _mm_and_ps(valid, _mm_cmplt_ps(t, _mm_set1_ps(nearest)));
+	int mask = _mm_movemask_ps(valid);
+	if (!mask)
+	{
+		return false;
+	}
+
+	float ts[4], us[4], vs[4];
+	_mm_storeu_ps(ts, t);
+	_mm_storeu_ps(us, u);
+	_mm_storeu_ps(vs, v);
+	for (int lane = 0; lane < 4; lane++)
+	{
+		if ((mask & (1 << lane)) && ts[lane] < nearest)
+		{
+			nearest = ts[lane];
+			hit.triangle = packet.triangle[lane];
+			hit.distance = ts[lane];
+			hit.barycentric = glm::vec2(us[lane], vs[lane]);
+		}
+	}
+	return true;
+#else
+	bool found = false;
+	for (int lane = 0; lane < 4; lane++)
+	{
+		glm::vec3 v0(packet.v0[0][lane], packet.v0[1][lane], packet.v0[2][lane]);
+		glm::vec3 edge1(packet.edge1[0][lane], packet.edge1[1][lane], packet.edge1[2][lane]);
+		glm::vec3 edge2(packet.edge2[0][lane], packet.edge2[1][lane], packet.edge2[2][lane]);
+		glm::vec3 p = glm::cross(ray.direction, edge2);
+		float determinant = glm::dot(edge1, p);
+		if (std::fabs(determinant) <= DETERMINANT_EPSILON)
+		{
+			continue;
+		}
+		float inverseDeterminant = 1.0f / determinant;
+		glm::vec3 s = ray.origin - v0;
+		float u = glm::dot(s, p) * inverseDeterminant;
+		glm::vec3 q = glm::cross(s, edge1);
+		float v = glm::dot(ray.direction, q) * inverseDeterminant;
+		float t = glm::dot(edge2, q) * inverseDeterminant;
+		if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f && t > 0.0f && t < nearest)
+		{
+			nearest = t;
+			hit.triangle = packet.triangle[lane];
+			hit.distance = t;
+			hit.barycentric = glm::vec2(u, v);
+			found = true;
+		}
+	}
+	return found;
+#endif
+}
+
+bool TriangleBVH::Intersect(const Ray &ray, float maxDistance, TriangleHit &hit) const
+{
+	if (nodes.empty())
+	{
+		return false;
+	}
+
+	glm::vec3 inverseDirection(1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z);
+	float nearest = maxDistance;
+	bool found = false;
+
+	// at most one pending sibling per level plus both children of the deepest inner node. balanced
+	// trees fit the fixed array, degenerate ones (long runs of coplanar slivers) get a heap stack
+	unsigned int fixedStack[64];
+	std::vector<unsigned int> deepStack;
+	unsigned int *stack = fixedStack;
+	if (depth + 1 > 64)
+	{
+		deepStack.resize(depth + 1);
+		stack = deepStack.data();
+	}
+	int stackSize = 0;
+	if (IntersectRayAABB(nodes[0].bounds, ray.origin, inverseDirection, nearest) >= 0.0f)
+	{
+		stack[stackSize++] = 0;
+	}
+	while (stackSize > 0)
+	{
+		const Node &node = nodes[stack[--stackSize]];
+		if (node.count > 0)
+		{
+			found |= intersectPacket(packets[node.leftFirst], ray, nearest, hit);
+			continue;
+		}
+
+		// visit the nearer child first so the farther one is usually rejected by the closer hit
+		float leftDistance = IntersectRayAABB(nodes[node.leftFirst].bounds, ray.origin, inverseDirection, nearest);
+		float rightDistance = IntersectRayAABB(nodes[node.leftFirst + 1].bounds, ray.origin, inverseDirection, nearest);
+		unsigned int nearChild = node.leftFirst, farChild = node.leftFirst + 1;
+		float nearDistance = leftDistance, farDistance = rightDistance;
+		if (nearDistance < 0.0f || (farDistance >= 0.0f && farDistance < nearDistance))
+		{
+			std::swap(nearChild, farChild);
+			std::swap(nearDistance, farDistance);
+		}
+		if (farDistance >= 0.0f)
+		{
+			stack[stackSize++] = farChild;
+		}
+		if (nearDistance >= 0.0f)
+		{
+			stack[stackSize++] = nearChild;
+		}
+	}
+	return found;
+}
+
+void Picker::Prepare(const SceneBVH &scene)
+{
+	for (unsigned int i = 0; i < scene.InstanceCount(); i++)
+	{
+		hierarchyFor(*scene.GetInstance(i).mesh);
+	}
+}
+
+const TriangleBVH &Picker::hierarchyFor(const Mesh &mesh)
+{
+	auto found = meshHierarchies.find(&mesh);
+	if (found != meshHierarchies.end())
+	{
+		return found->second;
+	}
+
+	TriangleBVH &hierarchy = meshHierarchies[&mesh];
+	if (!mesh.positions.empty())
+	{
+		hierarchy.Build(mesh.positions, mesh.indices);
+	}
+	else if (!mesh.vertices.empty())
+	{
+		std::vector<glm::vec3> positions;
+		positions.reserve(mesh.vertices.size());
+		for (const Vertex &vertex : mesh.vertices)
+		{
+			positions.push_back(vertex.Position);
+		}
+		hierarchy.Build(positions, mesh.indices);
+	}
+	// meshes without host geometry keep an empty hierarchy and are never hit
+	return hierarchy;
+}
+
+bool Picker::Pick(const SceneBVH &scene, const Ray &ray, float maxDistance, PickHit &hit)
+{
+	scene.QueryRay(ray, maxDistance, candidates);
+
+	float nearest = maxDistance;
+	bool found = false;
+	for (const RayCandidate &candidate : candidates)
+	{
+		// candidates come nearest box first, nothing past the closest hit can beat it
+		if (candidate.t >= nearest)
+		{
+			break;
+		}
+
+		const SceneInstance &instance = scene.GetInstance(candidate.instance);
+		const TriangleBVH &hierarchy = hierarchyFor(*instance.mesh);
+		if (hierarchy.Empty())
+		{
+			continue;
+		}
+
+		// the direction isn't normalized again, so distances along the object space ray match world space ones
+		glm::mat4 toObject = glm::inverse(instance.transform);
+		Ray objectRay;
+		objectRay.origin = glm::vec3(toObject * glm::vec4(ray.origin, 1.0f));
+		objectRay.direction = glm::vec3(toObject * glm::vec4(ray.direction, 0.0f));
+
+		TriangleHit triangleHit;
+		if (hierarchy.Intersect(objectRay, nearest, triangleHit))
+		{
+			nearest = triangleHit.distance;
+			hit.instance = candidate.instance;
+			hit.mesh = instance.mesh;
+			hit.triangle = triangleHit.triangle;
+			hit.distance = triangleHit.distance;
+			hit.position = ray.origin + ray.direction * triangleHit.distance;
+			hit.barycentric = triangleHit.barycentric;
+			found = true;
+		}
+	}
+	return found;
+}
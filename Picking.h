@@ -0,0 +1,85 @@
+#pragma once
+#include <glm/glm.hpp>
+
+#include "Camera.h"
+#include "Mesh.h"
+#include "Culling.h"
+#include "SceneBVH.h"
+
+#include <unordered_map>
+#include <vector>
+
+// ray through a window position (pixels, origin top left) of a perspective camera
+Ray CameraRay(const Camera &camera, float cursorX, float cursorY, float width, float height);
+
+struct TriangleHit {
+	unsigned int triangle;	// index of the triangle in the mesh, its indices start at 3 * triangle
+	float distance;
+	glm::vec2 barycentric;	// weights of the second and third vertex
+};
+
+// Bounding volume hierarchy over the triangles of one mesh. Leaves hold up to four triangles in
+// structure of arrays form so a ray is tested against all of them at once.
+class TriangleBVH
+{
+public:
+	/* Functions */
+	// positions are indexed like the mesh's indices
+	void Build(const std::vector<glm::vec3> &positions, const std::vector<unsigned int> &indices);
+	// nearest triangle hit before maxDistance, both faces count. distances are in units of ray.direction
+	bool Intersect(const Ray &ray, float maxDistance, TriangleHit &hit) const;
+	bool Empty() const { return nodes.empty(); }
+
+private:
+	/* BVH Data */
+	struct Node {
+		AABB bounds;
+		unsigned int leftFirst;	// leaf: packet index, otherwise the left child (right child is leftFirst + 1)
+		unsigned int count;		// 1 for leaves, 0 for inner nodes
+	};
+	// four triangles as first vertex and two edges, unused lanes are degenerate and never hit
+	struct TrianglePacket {
+		float v0[3][4];
+		float edge1[3][4];
+		float edge2[3][4];
+		unsigned int triangle[4];
+	};
+	std::vector<Node> nodes;
+	std::vector<TrianglePacket> packets;
+	// deepest leaf below the root, sizes the traversal stack
+	unsigned int depth = 0;
+
+	/* Functions */
+	void subdivide(unsigned int node, unsigned int nodeDepth, std::vector<unsigned int> &order, const std::vector<AABB> &boxes,
+		const std::vector<glm::vec3> &positions, const std::vector<unsigned int> &indices);
+	bool intersectPacket(const TrianglePacket &packet, const Ray &ray, float &nearest, TriangleHit &hit) const;
+};
+
+struct PickHit {
+	unsigned int instance;
+	Mesh *mesh;
+	unsigned int triangle;
+	float distance;
+	glm::vec3 position;		// world space
+	glm::vec2 barycentric;
+};
+
+// Finds the triangle under a ray: the scene hierarchy narrows it down to a few instances, their
+// triangle hierarchies do the rest. Meshes need their positions and indices on the CPU
+// (MESH_KEEP_POSITIONS or MESH_KEEP_ALL), others are skipped.
+class Picker
+{
+public:
+	/* Functions */
+	// builds the triangle hierarchies of every mesh in the scene, otherwise they're built on first hit
+	void Prepare(const SceneBVH &scene);
+	bool Pick(const SceneBVH &scene, const Ray &ray, float maxDistance, PickHit &hit);
+
+private:
+	/* Picking Data */
+	std::unordered_map<const Mesh*, TriangleBVH> meshHierarchies;
+	std::vector<RayCandidate> candidates;
+
+	/* Functions */
+	const TriangleBVH &hierarchyFor(const Mesh &mesh);
+};
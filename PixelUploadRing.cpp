@@ -0,0 +1,156 @@
+#include "PixelUploadRing.h"
+
+#include <cstring>
+
+// keeps every region's offset a multiple of any pixel size
+static const GLsizeiptr REGION_ALIGNMENT = 256;
+
+PixelUploadRing::PixelUploadRing(GLsizeiptr size)
+	: PBO(0), capacity(size), persistentData(nullptr), firstSequence(0), head(0)
+{
+	glGenBuffers(1, &PBO);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, PBO);
+
+#ifdef GL_VERSION_4_4
+	if (GLAD_GL_VERSION_4_4)
+	{
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_PIXEL_UNPACK_BUFFER, capacity, NULL, flags);
+		persistentData = static_cast<unsigned char*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, capacity, flags));
+	}
+#endif
+	if (!persistentData)
+	{
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, capacity, NULL, GL_STREAM_DRAW);
+	}
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+bool PixelUploadRing::Allocate(GLsizeiptr size, Region &region)
+{
+	size = (size + REGION_ALIGNMENT - 1) / REGION_ALIGNMENT * REGION_ALIGNMENT;
+	std::lock_guard<std::mutex> lock(mutex);
+
+	GLintptr offset;
+	if (allocations.empty())
+	{
+		// nothing in flight, start over at the beginning
+		head = 0;
+		if (size > capacity)
+		{
+			return false;
+		}
+		offset = 0;
+	}
+	else
+	{
+		// regions in use run from tail to head, wrapping around the end when head < tail.
+		// head never catches up with tail, equal would look like an empty ring
+		GLintptr tail = allocations.front().offset;
+		if (head > tail && head + size <= capacity)
+		{
+			offset = head;
+		}
+		else if (head > tail && size < tail)
+		{
+			// wrap, the rest of the ring behind head is skipped until tail passes it
+			offset = 0;
+		}
+		else if (head < tail && head + size < tail)
+		{
+			offset = head;
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	Allocation allocation;
+	allocation.offset = offset;
+	allocation.size = size;
+	allocation.submitted = false;
+	allocation.fence = 0;
+	allocations.push_back(allocation);
+	head = offset + size;
+
+	region.offset = offset;
+	region.size = size;
+	region.sequence = firstSequence + allocations.size() - 1;
+	region.data = persistentData ? persistentData + offset : nullptr;
+	return true;
+}
+
+void PixelUploadRing::Write(const Region &region, const void *pixels, GLsizeiptr size)
+{
+	if (region.data)
+	{
+		std::memcpy(region.data, pixels, size);
+		return;
+	}
+
+	// the region isn't in use by the GPU, so skip the driver's own synchronization
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, PBO);
+	const GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+	void *data = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, region.offset, size, access);
+	if (data)
+	{
+		std::memcpy(data, pixels, size);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void PixelUploadRing::Submit(const Region &region)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	Allocation &allocation = allocations[(size_t)(region.sequence - firstSequence)];
+	allocation.submitted = true;
+	allocation.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void PixelUploadRing::Retire()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	// regions are freed in ring order, one still waiting for its upload holds back the ones behind it
+	while (!allocations.empty() && allocations.front().submitted)
+	{
+		GLsync fence = allocations.front().fence;
+		if (fence)
+		{
+			GLenum result = glClientWaitSync(fence, 0, 0);
+			if (result == GL_TIMEOUT_EXPIRED)
+			{
+				break;
+			}
+			glDeleteSync(fence);
+		}
+		allocations.pop_front();
+		firstSequence++;
+	}
+}
+
+void PixelUploadRing::Release()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	for (Allocation &allocation : allocations)
+	{
+		if (allocation.fence)
+		{
+			glDeleteSync(allocation.fence);
+		}
+	}
+	firstSequence += allocations.size();
+	allocations.clear();
+
+	if (persistentData)
+	{
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, PBO);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		persistentData = nullptr;
+	}
+	glDeleteBuffers(1, &PBO);
+	PBO = 0;
+}
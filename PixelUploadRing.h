@@ -0,0 +1,61 @@
+#pragma once
+#include <glad/glad.h>
+
+#include <deque>
+#include <mutex>
+
+// Ring of pixel unpack buffer memory that texture uploads are staged in, so glTexImage2D copies from
+// the buffer on the GPU timeline instead of from client memory while the GL thread waits. Regions are
+// handed out in ring order and given back once the fence issued after their upload has signaled.
+// With GL 4.4 the ring is persistently mapped and any thread can fill a region it allocated, otherwise
+// the GL thread copies into it with an unsynchronized map (the fences make that safe).
+class PixelUploadRing
+{
+public:
+	static const GLsizeiptr DEFAULT_SIZE = 64 * 1024 * 1024;
+
+	struct Region {
+		GLintptr offset;
+		GLsizeiptr size;
+		unsigned long long sequence;
+		// where to write the pixels when the ring is persistently mapped, null otherwise
+		unsigned char *data;
+	};
+
+	/* Functions */
+	// needs a current GL context
+	explicit PixelUploadRing(GLsizeiptr size = DEFAULT_SIZE);
+
+	bool Persistent() const { return persistentData != nullptr; }
+	GLuint Buffer() const { return PBO; }
+
+	// any thread. false when the space isn't free (yet), regions bigger than the ring never are
+	bool Allocate(GLsizeiptr size, Region &region);
+	// copies pixels into a region through a temporary mapping, GL thread
+	void Write(const Region &region, const void *pixels, GLsizeiptr size);
+	// fences the region after the commands reading it, GL thread. every allocated region has to be submitted
+	void Submit(const Region &region);
+	// gives back the regions the GPU is done with, GL thread
+	void Retire();
+
+	// delete the GL objects, call before the context goes away
+	void Release();
+
+private:
+	/* Ring Data */
+	struct Allocation {
+		GLintptr offset;
+		GLsizeiptr size;
+		bool submitted;
+		GLsync fence;
+	};
+	GLuint PBO;
+	GLsizeiptr capacity;
+	unsigned char *persistentData;
+
+	std::mutex mutex;
+	// in ring order, the front is the oldest region still in use
+	std::deque<Allocation> allocations;
+	unsigned long long firstSequence;
+	GLintptr head;
+};
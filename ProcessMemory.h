@@ -0,0 +1,6 @@
+#pragma once
+
+#include <cstddef>
+
+// highest resident set (working set on Windows) of the process so far in bytes, 0 where it can't be queried
+size_t PeakResidentBytes();
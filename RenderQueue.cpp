@@ -0,0 +1,195 @@
+#include "RenderQueue.h"
+#include "GLState.h"
+
+#include <algorithm>
+
+static const unsigned int DEPTH_BITS = 20;
+static const unsigned int VAO_BITS = 12;
+static const unsigned int MATERIAL_BITS = 16;
+static const unsigned int PROGRAM_BITS = 12;
+
+static uint64_t keyField(uint64_t value, unsigned int bits, unsigned int shift)
+{
+	return (value & ((1ull << bits) - 1ull)) << shift;
+}
+
+void RenderQueue::Begin(const glm::vec3 &viewPos, float farPlane)
+{
+	this->viewPos = viewPos;
+	this->farPlane = farPlane > 0.0f ? farPlane : 1.0f;
+	culling = false;
+	items.clear();
+	entries.clear();
+}
+
+void RenderQueue::Begin(const glm::vec3 &viewPos, float farPlane, const Frustum &frustum)
+{
+	Begin(viewPos, farPlane);
+	this->frustum = frustum;
+	culling = true;
+}
+
+void RenderQueue::Submit(RenderPass pass, const Shader &shader, Mesh &mesh, const glm::mat4 &transform, unsigned int lod)
+{
+	// front to back for opaque draws, back to front for transparent ones. measured from the center of
+	// the mesh rather than the instance origin, the meshes of one model all share that
+	glm::vec3 center = (mesh.bounds.box.min + mesh.bounds.box.max) * 0.5f;
+	glm::vec3 position = glm::vec3(transform * glm::vec4(center, 1.0f));
+	float distance = glm::length(position - viewPos) / farPlane;
+	distance = std::min(std::max(distance, 0.0f), 1.0f);
+	uint64_t depth = (uint64_t)(distance * ((1u << DEPTH_BITS) - 1u));
+	if (pass == RENDER_PASS_TRANSPARENT)
+	{
+		depth = ((1u << DEPTH_BITS) - 1u) - depth;
+	}
+
+	SortEntry entry;
+	entry.item = (uint32_t)items.size();
+	if (pass == RENDER_PASS_TRANSPARENT)
+	{
+		// blending needs the depth order, state sorting comes second
+		entry.key = keyField(pass, 4, 60)
+			| keyField(depth, DEPTH_BITS, 40)
+			| keyField(shader.ID, PROGRAM_BITS, 28)
+			| keyField(mesh.MaterialKey(), MATERIAL_BITS, 12)
+			| keyField(mesh.VAO, VAO_BITS, 0);
+	}
+	else
+	{
+		entry.key = keyField(pass, 4, 60)
+			| keyField(shader.ID, PROGRAM_BITS, 48)
+			| keyField(mesh.MaterialKey(), MATERIAL_BITS, 32)
+			| keyField(mesh.VAO, VAO_BITS, 20)
+			| keyField(depth, DEPTH_BITS, 0);
+	}
+	entries.push_back(entry);
+
+	Item item;
+	item.shader = &shader;
+	item.mesh = &mesh;
+	item.transform = transform;
+	item.lod = lod;
+	items.push_back(item);
+}
+
+void RenderQueue::cullEntries()
+{
+	cullBounds.Clear();
+	cullBounds.Reserve(entries.size());
+	for (const SortEntry &entry : entries)
+	{
+		const Item &item = items[entry.item];
+		cullBounds.Add(TransformAABB(item.mesh->bounds.box, item.transform));
+	}
+	CullBatch(frustum, cullBounds, cullVisible);
+
+	// compact the visible entries in place, keeping their order
+	size_t kept = 0;
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		if (cullVisible[i])
+		{
+			entries[kept++] = entries[i];
+		}
+	}
+	stats.culled = (unsigned int)(entries.size() - kept);
+	entries.resize(kept);
+}
+
+void RenderQueue::sortEntries()
+{
+	// LSD radix sort, 8 bits per pass. all histograms are built in one sweep and
+	// passes where every key has the same byte are skipped
+	size_t count = entries.size();
+	scratch.resize(count);
+
+	uint32_t histograms[8][256] = {};
+	for (const SortEntry &entry : entries)
+	{
+		for (unsigned int pass = 0; pass < 8; pass++)
+		{
+			histograms[pass][(entry.key >> (pass * 8)) & 0xff]++;
+		}
+	}
+
+	for (unsigned int pass = 0; pass < 8; pass++)
+	{
+		uint32_t *histogram = histograms[pass];
+		if (histogram[(entries[0].key >> (pass * 8)) & 0xff] == count)
+		{
+			continue;
+		}
+
+		uint32_t offset = 0;
+		for (unsigned int bucket = 0; bucket < 256; bucket++)
+		{
+			uint32_t bucketCount = histogram[bucket];
+			histogram[bucket] = offset;
+			offset += bucketCount;
+		}
+		for (const SortEntry &entry : entries)
+		{
+			scratch[histogram[(entry.key >> (pass * 8)) & 0xff]++] = entry;
+		}
+		entries.swap(scratch);
+	}
+}
+
+void RenderQueue::Flush()
+{
+	stats = Stats();
+	if (culling)
+	{
+		cullEntries();
+	}
+	if (entries.empty())
+	{
+		items.clear();
+		return;
+	}
+	sortEntries();
+
+	const Shader *currentShader = nullptr;
+	const Mesh *currentMaterial = nullptr;
+	unsigned int currentVAO = 0;
+	GLint modelLocation = -1;
+
+	for (const SortEntry &entry : entries)
+	{
+		const Item &item = items[entry.item];
+
+		if (item.shader != currentShader)
+		{
+			currentShader = item.shader;
+			currentShader->use();
+			modelLocation = currentShader->getUniformLocation("model");
+			// sampler uniforms belong to the program, so the material has to be bound again
+			currentMaterial = nullptr;
+			stats.programBinds++;
+		}
+
+		if (!currentMaterial || !currentMaterial->CanBatchWith(*item.mesh))
+		{
+			item.mesh->BindMaterial(*currentShader);
+			currentMaterial = item.mesh;
+			stats.materialBinds++;
+		}
+
+		if (item.mesh->VAO != currentVAO)
+		{
+			currentVAO = item.mesh->VAO;
+			GLState::Shared().BindVertexArray(currentVAO);
+			stats.vertexArrayBinds++;
+		}
+
+		currentShader->setMat4(modelLocation, item.transform);
+		item.mesh->DrawElements(item.lod);
+		stats.draws++;
+	}
+
+	// always good practice to set everything back to default once configured;
+	GLState::Shared().ActiveTexture(GL_TEXTURE0);
+
+	items.clear();
+	entries.clear();
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "Shader.h"
+#include "Mesh.h"
+#include "Culling.h"
+
+#include <cstdint>
+#include <vector>
+
+// passes run in this order, draws within a pass are sorted by state and then front to back
+enum RenderPass {
+	RENDER_PASS_OPAQUE,
+	RENDER_PASS_TRANSPARENT,
+	RENDER_PASS_OVERLAY
+};
+
+// Per-frame list of draws. Everything submitted between Begin() and Flush() is sorted on a 64 bit key
+//   pass (4) | program (12) | material (16) | VAO (12) | depth (20)
+// and executed in that order, skipping program, material and VAO binds that are already current.
+// With a frustum, invisible draws are culled first using the world space bounds of each mesh.
+class RenderQueue
+{
+public:
+	/* Functions */
+	// starts a frame, depth is the distance to viewPos normalized by farPlane
+	void Begin(const glm::vec3 &viewPos, float farPlane);
+	// same, but draws whose bounds are outside the frustum are dropped in one batch before sorting
+	void Begin(const glm::vec3 &viewPos, float farPlane, const Frustum &frustum);
+	void Submit(RenderPass pass, const Shader &shader, Mesh &mesh, const glm::mat4 &transform, unsigned int lod = 0);
+	// sorts and executes everything submitted since Begin(), call on the GL thread
+	void Flush();
+
+	// state changes of the last flush
+	struct Stats {
+		unsigned int draws;
+		unsigned int culled;
+		unsigned int programBinds;
+		unsigned int materialBinds;
+		unsigned int vertexArrayBinds;
+	};
+	const Stats &LastStats() const { return stats; }
+
+private:
+	/* Queue Data */
+	struct Item {
+		const Shader *shader;
+		Mesh *mesh;
+		glm::mat4 transform;
+		unsigned int lod;
+	};
+	struct SortEntry {
+		uint64_t key;
+		uint32_t item;
+	};
+	// cleared but never shrunk, so a steady frame doesn't allocate
+	std::vector<Item> items;
+	std::vector<SortEntry> entries;
+	std::vector<SortEntry> scratch;
+	glm::vec3 viewPos;
+	float farPlane = 1.0f;
+	bool culling = false;
+	Frustum frustum;
+	BoundsBatch cullBounds;
+	std::vector<unsigned char> cullVisible;
+	Stats stats = {};
+
+	/* Functions */
+	void cullEntries();
+	void sortEntries();
+};
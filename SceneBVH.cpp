@@ -0,0 +1,340 @@
+#include "SceneBVH.h"
+#include "Occlusion.h"
+
+#include <algorithm>
+#include <cmath>
+
+static const unsigned int NO_PARENT = 0xffffffffu;
+static const int SAH_BINS = 12;
+
+unsigned int SceneBVH::AddInstance(Mesh *mesh, const glm::mat4 &transform)
+{
+	SceneInstance instance;
+	instance.mesh = mesh;
+	instance.transform = transform;
+	instance.bounds = TransformAABB(mesh->bounds.box, transform);
+	instance.lod = 0;
+	instances.push_back(instance);
+	return (unsigned int)instances.size() - 1;
+}
+
+void SceneBVH::SetTransform(unsigned int instance, const glm::mat4 &transform)
+{
+	SceneInstance &moved = instances[instance];
+	moved.transform = transform;
+	moved.bounds = TransformAABB(moved.mesh->bounds.box, transform);
+
+	if (instance >= leafOfInstance.size())
+	{
+		return; // not in the tree yet, the next Build() picks it up
+	}
+
+	// mark the path to the root, stopping where an earlier move already did
+	unsigned int node = leafOfInstance[instance];
+	while (node != NO_PARENT && !nodes[node].dirty)
+	{
+		nodes[node].dirty = true;
+		node = nodes[node].parent;
+	}
+	needsRefit = true;
+}
+
+void SceneBVH::Build()
+{
+	nodes.clear();
+	order.resize(instances.size());
+	leafOfInstance.assign(instances.size(), 0);
+	needsRefit = false;
+	if (instances.empty())
+	{
+		return;
+	}
+	for (unsigned int i = 0; i < order.size(); i++)
+	{
+		order[i] = i;
+	}
+
+	// a binary tree with n leaves never has more than 2n - 1 nodes, so references stay valid while building
+	nodes.reserve(instances.size() * 2);
+	Node root;
+	root.leftFirst = 0;
+	root.count = (unsigned int)instances.size();
+	root.parent = NO_PARENT;
+	root.dirty = false;
+	nodes.push_back(root);
+	updateLeafBounds(nodes[0]);
+	subdivide(0);
+
+	for (unsigned int i = 0; i < nodes.size(); i++)
+	{
+		const Node &node = nodes[i];
+		for (unsigned int j = 0; j < node.count; j++)
+		{
+			leafOfInstance[order[node.leftFirst + j]] = i;
+		}
+	}
+}
+
+void SceneBVH::updateLeafBounds(Node &node)
+{
+	node.bounds = EmptyAABB();
+	for (unsigned int i = 0; i < node.count; i++)
+	{
+		GrowAABB(node.bounds, instances[order[node.leftFirst + i]].bounds);
+	}
+}
+
+void SceneBVH::subdivide(unsigned int nodeIndex)
+{
+	Node &node = nodes[nodeIndex];
+	if (node.count <= 1)
+	{
+		return;
+	}
+
+	// binned SAH over all three axes
+	SAHSplit split = FindSAHSplit(node.count, SAH_BINS, [&](unsigned int i) -> const AABB& {
+		return instances[order[node.leftFirst + i]].bounds;
+	});
+
+	// splitting has to beat testing every instance of this node
+	float leafCost = AABBSurfaceArea(node.bounds) * node.count;
+	if (split.axis < 0 || split.cost >= leafCost)
+	{
+		return;
+	}
+
+	unsigned int *first = &order[node.leftFirst];
+	unsigned int *middle = std::partition(first, first + node.count, [&](unsigned int instance) {
+		return split.IsLeft(AABBCenter(instances[instance].bounds));
+	});
+	unsigned int leftCount = (unsigned int)(middle - first);
+
+	unsigned int leftIndex = (unsigned int)nodes.size();
+	Node left;
+	left.leftFirst = node.leftFirst;
+	left.count = leftCount;
+	left.parent = nodeIndex;
+	left.dirty = false;
+	Node right;
+	right.leftFirst = node.leftFirst + leftCount;
+	right.count = node.count - leftCount;
+	right.parent = nodeIndex;
+	right.dirty = false;
+	nodes.push_back(left);
+	nodes.push_back(right);
+	updateLeafBounds(nodes[leftIndex]);
+	updateLeafBounds(nodes[leftIndex + 1]);
+
+	node.leftFirst = leftIndex;
+	node.count = 0;
+	subdivide(leftIndex);
+	subdivide(leftIndex + 1);
+}
+
+void SceneBVH::Refit()
+{
+	if (!needsRefit)
+	{
+		return;
+	}
+
+	// children come after their parent, so walking backwards refits bottom up
+	for (size_t i = nodes.size(); i-- > 0;)
+	{
+		Node &node = nodes[i];
+		if (!node.dirty)
+		{
+			continue;
+		}
+		if (node.count > 0)
+		{
+			updateLeafBounds(node);
+		}
+		else
+		{
+			node.bounds = nodes[node.leftFirst].bounds;
+			GrowAABB(node.bounds, nodes[node.leftFirst + 1].bounds);
+		}
+		node.dirty = false;
+	}
+	needsRefit = false;
+}
+
+void SceneBVH::collectSubtree(unsigned int nodeIndex, std::vector<unsigned int> &visible) const
+{
+	const Node &node = nodes[nodeIndex];
+	if (node.count > 0)
+	{
+		visible.insert(visible.end(), order.begin() + node.leftFirst, order.begin() + node.leftFirst + node.count);
+		return;
+	}
+	collectSubtree(node.leftFirst, visible);
+	collectSubtree(node.leftFirst + 1, visible);
+}
+
+unsigned int SceneBVH::CullFrustum(const Frustum &frustum, std::vector<unsigned int> &visible) const
+{
+	if (nodes.empty())
+	{
+		return 0;
+	}
+
+	// each entry carries the planes its ancestors weren't completely inside of
+	struct StackEntry {
+		unsigned int node;
+		unsigned int planeMask;
+	};
+	StackEntry stack[64];
+	int stackSize = 0;
+	stack[stackSize++] = { 0, 0x3f };
+	unsigned int visited = 0;
+	leafCandidates.clear();
+
+	while (stackSize > 0)
+	{
+		StackEntry entry = stack[--stackSize];
+		const Node &node = nodes[entry.node];
+		visited++;
+
+		glm::vec3 center = AABBCenter(node.bounds);
+		glm::vec3 extent = (node.bounds.max - node.bounds.min) * 0.5f;
+		unsigned int planeMask = entry.planeMask;
+		bool outside = false;
+		for (int p = 0; p < 6 && !outside; p++)
+		{
+			if (!(planeMask & (1u << p)))
+			{
+				continue;
+			}
+			const glm::vec4 &plane = frustum.planes[p];
+			float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+			float radius = std::fabs(plane.x) * extent.x + std::fabs(plane.y) * extent.y + std::fabs(plane.z) * extent.z;
+			if (distance + radius < 0.0f)
+			{
+				outside = true;
+			}
+			else if (distance - radius >= 0.0f)
+			{
+				planeMask &= ~(1u << p);
+			}
+		}
+
+		if (outside)
+		{
+			continue;
+		}
+		if (planeMask == 0)
+		{
+			// a whole district inside the view, no further tests needed
+			collectSubtree(entry.node, visible);
+		}
+		else if (node.count > 0)
+		{
+			leafCandidates.insert(leafCandidates.end(), order.begin() + node.leftFirst, order.begin() + node.leftFirst + node.count);
+		}
+		else if (stackSize + 2 <= 64)
+		{
+			stack[stackSize++] = { node.leftFirst, planeMask };
+			stack[stackSize++] = { node.leftFirst + 1, planeMask };
+		}
+		else
+		{
+			collectSubtree(entry.node, visible); // deeper than any sane scene, be conservative
+		}
+	}
+
+	if (!leafCandidates.empty())
+	{
+		leafBounds.Clear();
+		leafBounds.Reserve(leafCandidates.size());
+		for (unsigned int instance : leafCandidates)
+		{
+			leafBounds.Add(instances[instance].bounds);
+		}
+		CullBatch(frustum, leafBounds, leafVisible);
+		for (size_t i = 0; i < leafCandidates.size(); i++)
+		{
+			if (leafVisible[i])
+			{
+				visible.push_back(leafCandidates[i]);
+			}
+		}
+	}
+	return visited;
+}
+
+void SceneBVH::QueryRay(const Ray &ray, float maxDistance, std::vector<RayCandidate> &candidates) const
+{
+	candidates.clear();
+	if (nodes.empty())
+	{
+		return;
+	}
+
+	// division by zero gives infinities, which the slab test handles
+	glm::vec3 inverseDirection(1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z);
+
+	unsigned int stack[64];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+	std::vector<unsigned int> subtree;
+	while (stackSize > 0)
+	{
+		const Node &node = nodes[stack[--stackSize]];
+		if (IntersectRayAABB(node.bounds, ray.origin, inverseDirection, maxDistance) < 0.0f)
+		{
+			continue;
+		}
+
+		if (node.count == 0 && stackSize + 2 <= 64)
+		{
+			stack[stackSize++] = node.leftFirst;
+			stack[stackSize++] = node.leftFirst + 1;
+			continue;
+		}
+
+		// a leaf, or a subtree deeper than the stack which is then tested instance by instance
+		subtree.clear();
+		collectSubtree((unsigned int)(&node - nodes.data()), subtree);
+		for (unsigned int instance : subtree)
+		{
+			float t = IntersectRayAABB(instances[instance].bounds, ray.origin, inverseDirection, maxDistance);
+			if (t >= 0.0f)
+			{
+				RayCandidate candidate;
+				candidate.instance = instance;
+				candidate.t = t;
+				candidates.push_back(candidate);
+			}
+		}
+	}
+
+	std::sort(candidates.begin(), candidates.end(), [](const RayCandidate &a, const RayCandidate &b) {
+		return a.t < b.t;
+	});
+}
+
+void SceneBVH::UpdateLods(const LodSelector &selector)
+{
+	for (SceneInstance &instance : instances)
+	{
+		instance.lod = selector.Select(*instance.mesh, instance.transform, instance.bounds, instance.lod);
+	}
+}
+
+void SceneBVH::Submit(RenderQueue &queue, RenderPass pass, const Shader &shader, const Frustum &frustum,
+	const OcclusionCuller *occlusion)
+{
+	Refit();
+	visibleScratch.clear();
+	CullFrustum(frustum, visibleScratch);
+	for (unsigned int instance : visibleScratch)
+	{
+		if (occlusion && !occlusion->IsVisible(instances[instance].bounds))
+		{
+			continue;
+		}
+		queue.Submit(pass, shader, *instances[instance].mesh, instances[instance].transform, instances[instance].lod);
+	}
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <glm/glm.hpp>
+
+#include "Shader.h"
+#include "Mesh.h"
+#include "Culling.h"
+#include "RenderQueue.h"
+#include "Lod.h"
+
+#include <vector>
+
+class OcclusionCuller;
+
+struct Ray {
+	glm::vec3 origin;
+	glm::vec3 direction;
+};
+
+// instance whose world space box the ray passes through, t is where it enters the box
+struct RayCandidate {
+	unsigned int instance;
+	float t;
+};
+
+// A mesh placed in the scene. The mesh is borrowed and has to outlive the scene.
+struct SceneInstance {
+	Mesh *mesh;
+	glm::mat4 transform;
+	AABB bounds;	// world space
+	unsigned int lod;	// level of detail drawn last frame
+};
+
+// Bounding volume hierarchy over mesh instances, built with the surface area heuristic and stored as a flat
+// array (children are always stored after their parent, the right child right after the left one).
+// Moving instances only refits the boxes on the path to the root, call Build() again after adding instances.
+class SceneBVH
+{
+public:
+	/* Functions */
+	unsigned int AddInstance(Mesh *mesh, const glm::mat4 &transform);
+	void SetTransform(unsigned int instance, const glm::mat4 &transform);
+	const SceneInstance &GetInstance(unsigned int instance) const { return instances[instance]; }
+	size_t InstanceCount() const { return instances.size(); }
+
+	void Build();
+	// updates the boxes of nodes above instances moved since the last Build() or Refit()
+	void Refit();
+
+	// appends the visible instances, subtrees completely inside the frustum are accepted without
+	// testing their children, instances of leaves crossing it are tested in one SIMD batch at the end.
+	// returns the number of nodes visited
+	unsigned int CullFrustum(const Frustum &frustum, std::vector<unsigned int> &visible) const;
+	// instances whose box the ray hits before maxDistance, nearest box first
+	void QueryRay(const Ray &ray, float maxDistance, std::vector<RayCandidate> &candidates) const;
+
+	// picks the level of detail of every instance, keeping track of the last one for hysteresis
+	void UpdateLods(const LodSelector &selector);
+
+	// frustum culls and queues every visible instance, with an occlusion culler those hidden behind
+	// its occluders are dropped as well
+	void Submit(RenderQueue &queue, RenderPass pass, const Shader &shader, const Frustum &frustum,
+		const OcclusionCuller *occlusion = nullptr);
+
+private:
+	/* BVH Data */
+	struct Node {
+		AABB bounds;
+		// leaf: first entry in order, otherwise the left child (right child is leftFirst + 1)
+		unsigned int leftFirst;
+		unsigned int count;		// 0 for inner nodes
+		unsigned int parent;
+		bool dirty;
+	};
+	std::vector<SceneInstance> instances;
+	std::vector<Node> nodes;
+	// instance indices, leaves reference contiguous ranges of this
+	std::vector<unsigned int> order;
+	std::vector<unsigned int> leafOfInstance;
+	bool needsRefit = false;
+	std::vector<unsigned int> visibleScratch;
+	// instances of leaves crossing a frustum plane, tested together with CullBatch once the traversal is done
+	mutable std::vector<unsigned int> leafCandidates;
+	mutable BoundsBatch leafBounds;
+	mutable std::vector<unsigned char> leafVisible;
+
+	/* Functions */
+	void subdivide(unsigned int node);
+	void updateLeafBounds(Node &node);
+	void collectSubtree(unsigned int node, std::vector<unsigned int> &visible) const;
+};
@@ -4,10 +4,13 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include "GLState.h"
+
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <vector>
 
 class Shader
 {
@@ -68,73 +71,290 @@ public:
 		// delete the shaders as they're linked into our program now and no longer necessary
 		glDeleteShader(vertex);
 		glDeleteShader(fragment);
+		// look up every active uniform once so the setters never have to ask the driver
+		reflectUniforms();
 	}
 	// activate the shader
 	// ------------------------------------------------------------------------
-	void use()
+	void use() const
+	{
+		GLState::Shared().UseProgram(ID);
+	}
+	// uniform locations are resolved once at link time, -1 when the program has no such uniform
+	// ------------------------------------------------------------------------
+	GLint getUniformLocation(const std::string &name) const
+	{
+		return findUniform(name.c_str(), name.size());
+	}
+	GLint getUniformLocation(const char *name) const
 	{
-		glUseProgram(ID);
+		return findUniform(name, std::char_traits<char>::length(name));
 	}
-	// utility uniform functions
+	// utility uniform functions, string literals take the const char* versions and skip building a std::string
 	// ------------------------------------------------------------------------
 	void setBool(const std::string &name, bool value) const
 	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+		setBool(getUniformLocation(name), value);
+	}
+	void setBool(const char *name, bool value) const
+	{
+		setBool(getUniformLocation(name), value);
+	}
+	void setBool(GLint location, bool value) const
+	{
+		glUniform1i(location, (int)value);
 	}
 	// ------------------------------------------------------------------------
 	void setInt(const std::string &name, int value) const
 	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+		setInt(getUniformLocation(name), value);
+	}
+	void setInt(const char *name, int value) const
+	{
+		setInt(getUniformLocation(name), value);
+	}
+	void setInt(GLint location, int value) const
+	{
+		glUniform1i(location, value);
 	}
 	// ------------------------------------------------------------------------
 	void setFloat(const std::string &name, float value) const
 	{
-		glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+		setFloat(getUniformLocation(name), value);
+	}
+	void setFloat(const char *name, float value) const
+	{
+		setFloat(getUniformLocation(name), value);
+	}
+	void setFloat(GLint location, float value) const
+	{
+		glUniform1f(location, value);
 	}
 	// ------------------------------------------------------------------------
 	void setVec2(const std::string &name, const glm::vec2 &value) const
 	{
-		glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+		setVec2(getUniformLocation(name), value);
+	}
+	void setVec2(const char *name, const glm::vec2 &value) const
+	{
+		setVec2(getUniformLocation(name), value);
+	}
+	void setVec2(GLint location, const glm::vec2 &value) const
+	{
+		glUniform2fv(location, 1, &value[0]);
 	}
 	void setVec2(const std::string &name, float x, float y) const
 	{
-		glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+		setVec2(getUniformLocation(name), x, y);
+	}
+	void setVec2(const char *name, float x, float y) const
+	{
+		setVec2(getUniformLocation(name), x, y);
+	}
+	void setVec2(GLint location, float x, float y) const
+	{
+		glUniform2f(location, x, y);
 	}
 	// ------------------------------------------------------------------------
 	void setVec3(const std::string &name, const glm::vec3 &value) const
 	{
-		glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+		setVec3(getUniformLocation(name), value);
+	}
+	void setVec3(const char *name, const glm::vec3 &value) const
+	{
+		setVec3(getUniformLocation(name), value);
+	}
+	void setVec3(GLint location, const glm::vec3 &value) const
+	{
+		glUniform3fv(location, 1, &value[0]);
 	}
 	void setVec3(const std::string &name, float x, float y, float z) const
 	{
-		glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+		setVec3(getUniformLocation(name), x, y, z);
+	}
+	void setVec3(const char *name, float x, float y, float z) const
+	{
+		setVec3(getUniformLocation(name), x, y, z);
+	}
+	void setVec3(GLint location, float x, float y, float z) const
+	{
+		glUniform3f(location, x, y, z);
 	}
 	// ------------------------------------------------------------------------
 	void setVec4(const std::string &name, const glm::vec4 &value) const
 	{
-		glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+		setVec4(getUniformLocation(name), value);
+	}
+	void setVec4(const char *name, const glm::vec4 &value) const
+	{
+		setVec4(getUniformLocation(name), value);
+	}
+	void setVec4(GLint location, const glm::vec4 &value) const
+	{
+		glUniform4fv(location, 1, &value[0]);
 	}
 	void setVec4(const std::string &name, float x, float y, float z, float w) const
 	{
-		glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+		setVec4(getUniformLocation(name), x, y, z, w);
+	}
+	void setVec4(const char *name, float x, float y, float z, float w) const
+	{
+		setVec4(getUniformLocation(name), x, y, z, w);
+	}
+	void setVec4(GLint location, float x, float y, float z, float w) const
+	{
+		glUniform4f(location, x, y, z, w);
 	}
 	// ------------------------------------------------------------------------
 	void setMat2(const std::string &name, const glm::mat2 &mat) const
 	{
-		glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		setMat2(getUniformLocation(name), mat);
+	}
+	void setMat2(const char *name, const glm::mat2 &mat) const
+	{
+		setMat2(getUniformLocation(name), mat);
+	}
+	void setMat2(GLint location, const glm::mat2 &mat) const
+	{
+		glUniformMatrix2fv(location, 1, GL_FALSE, &mat[0][0]);
 	}
 	// ------------------------------------------------------------------------
 	void setMat3(const std::string &name, const glm::mat3 &mat) const
 	{
-		glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		setMat3(getUniformLocation(name), mat);
+	}
+	void setMat3(const char *name, const glm::mat3 &mat) const
+	{
+		setMat3(getUniformLocation(name), mat);
+	}
+	void setMat3(GLint location, const glm::mat3 &mat) const
+	{
+		glUniformMatrix3fv(location, 1, GL_FALSE, &mat[0][0]);
 	}
 	// ------------------------------------------------------------------------
 	void setMat4(const std::string &name, const glm::mat4 &mat) const
 	{
-		glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		setMat4(getUniformLocation(name), mat);
+	}
+	void setMat4(const char *name, const glm::mat4 &mat) const
+	{
+		setMat4(getUniformLocation(name), mat);
+	}
+	void setMat4(GLint location, const glm::mat4 &mat) const
+	{
+		glUniformMatrix4fv(location, 1, GL_FALSE, &mat[0][0]);
 	}
 	
 private:
+	// open addressing hash table of uniform name -> location, filled once after linking
+	struct UniformSlot {
+		size_t hash;
+		std::string name;
+		GLint location;
+	};
+	std::vector<UniformSlot> uniformSlots;
+
+	static size_t hashName(const char *name, size_t length)
+	{
+		// FNV-1a
+		size_t hash = (size_t)2166136261u;
+		for (size_t i = 0; i < length; i++)
+		{
+			hash ^= (unsigned char)name[i];
+			hash *= (size_t)16777619u;
+		}
+		return hash;
+	}
+
+	GLint findUniform(const char *name, size_t length) const
+	{
+		if (uniformSlots.empty())
+		{
+			return -1;
+		}
+		size_t mask = uniformSlots.size() - 1;
+		size_t hash = hashName(name, length);
+		for (size_t i = hash & mask; ; i = (i + 1) & mask)
+		{
+			const UniformSlot &slot = uniformSlots[i];
+			if (slot.location == -1)
+			{
+				return -1;
+			}
+			if (slot.hash == hash && slot.name.size() == length && slot.name.compare(0, length, name, length) == 0)
+			{
+				return slot.location;
+			}
+		}
+	}
+
+	void insertUniform(const std::string &name, GLint location)
+	{
+		size_t mask = uniformSlots.size() - 1;
+		size_t hash = hashName(name.c_str(), name.size());
+		size_t i = hash & mask;
+		while (uniformSlots[i].location != -1)
+		{
+			i = (i + 1) & mask;
+		}
+		uniformSlots[i].hash = hash;
+		uniformSlots[i].name = name;
+		uniformSlots[i].location = location;
+	}
+
+	void reflectUniforms()
+	{
+		GLint uniformCount = 0;
+		GLint maxNameLength = 0;
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &uniformCount);
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+
+		// arrays are reported once as "name[0]", expand them to every element plus the bare name
+		std::vector<std::pair<std::string, GLint>> uniforms;
+		std::vector<char> nameBuffer(maxNameLength > 0 ? maxNameLength : 1);
+		for (GLint i = 0; i < uniformCount; i++)
+		{
+			GLsizei length = 0;
+			GLint size = 0;
+			GLenum type = 0;
+			glGetActiveUniform(ID, (GLuint)i, (GLsizei)nameBuffer.size(), &length, &size, &type, nameBuffer.data());
+			std::string name(nameBuffer.data(), length);
+
+			GLint location = glGetUniformLocation(ID, name.c_str());
+			if (location == -1)
+			{
+				continue; // uniform block members don't have a location
+			}
+			uniforms.push_back(std::make_pair(name, location));
+
+			if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+			{
+				std::string base = name.substr(0, name.size() - 3);
+				uniforms.push_back(std::make_pair(base, location));
+				for (GLint element = 1; element < size; element++)
+				{
+					std::string elementName = base + "[" + std::to_string(element) + "]";
+					uniforms.push_back(std::make_pair(elementName, glGetUniformLocation(ID, elementName.c_str())));
+				}
+			}
+		}
+
+		// keep the table at most half full so probe sequences stay short
+		size_t capacity = 16;
+		while (capacity < uniforms.size() * 2)
+		{
+			capacity *= 2;
+		}
+		uniformSlots.assign(capacity, UniformSlot{ 0, std::string(), -1 });
+		for (const std::pair<std::string, GLint> &uniform : uniforms)
+		{
+			if (uniform.second != -1)
+			{
+				insertUniform(uniform.first, uniform.second);
+			}
+		}
+	}
+
 	// utility function for checking shader compilation/linking errors.
 	// ------------------------------------------------------------------------
 	void checkCompileErrors(unsigned int shader, std::string type)
@@ -0,0 +1,410 @@
+#include "TextureManager.h"
+#include "BakedTexture.h"
+#include "GLState.h"
+#include "stb_image.h"
+
+#include <cstring>
+#include <iostream>
+
+uint64_t TextureImageHash(const unsigned char *pixels, int width, int height, int nrComponents)
+{
+	// FNV-1a style mixing, eight bytes at a time
+	uint64_t hash = 14695981039346656037ull;
+	const uint64_t prime = 1099511628211ull;
+	uint64_t header[3] = { (uint64_t)width, (uint64_t)height, (uint64_t)nrComponents };
+	for (uint64_t value : header)
+	{
+		hash = (hash ^ value) * prime;
+	}
+
+	size_t size = (size_t)width * height * nrComponents;
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8)
+	{
+		uint64_t word;
+		std::memcpy(&word, pixels + i, sizeof(word));
+		hash = (hash ^ word) * prime;
+	}
+	for (; i < size; i++)
+	{
+		hash = (hash ^ pixels[i]) * prime;
+	}
+	// 0 means no content
+	return hash ? hash : 1;
+}
+
+TextureImage DecodeTextureImage(const char *path, const std::string &directory)
+{
+	std::string filename = std::string(path);
+	filename = directory + "/" + filename;
+
+	TextureImage image;
+	image.path = std::string(path);
+	if (BakedTexture::Load(filename, image))
+	{
+		return image;
+	}
+	// bake it now (this runs on a loader thread), a bake that exists but can't be used isn't redone
+	TextureBakeOptions bakeOptions;
+	if (BakedTexture::BakeOnImport(bakeOptions) && !BakedTexture::IsCurrent(filename)
+		&& BakedTexture::Bake(filename, bakeOptions) && BakedTexture::Load(filename, image))
+	{
+		return image;
+	}
+	unsigned char *data = stbi_load(filename.c_str(), &image.width, &image.height, &image.nrComponents, 0);
+	image.data = std::shared_ptr<unsigned char>(data, stbi_image_free);
+	image.contentHash = data ? TextureImageHash(data, image.width, image.height, image.nrComponents) : 0;
+	return image;
+}
+
+unsigned int UploadTextureImage(const TextureImage &image, bool gamma)
+{
+	unsigned int textureID;
+	glGenTextures(1, &textureID);
+	UploadTextureImage(textureID, image, gamma);
+	return textureID;
+}
+
+void UploadTextureImage(unsigned int textureID, const TextureImage &image, bool gamma)
+{
+	if (image.data)
+	{
+		UploadTextureImage(textureID, image, image.data.get(), gamma);
+	}
+	else
+	{
+		std::cout << "Texture failed to load at path: " << image.path << std::endl;
+	}
+}
+
+void UploadTextureImage(unsigned int textureID, const TextureImage &image, const void *pixels, bool gamma)
+{
+	GLenum format;
+	if (image.nrComponents == 1)
+	{
+		format = GL_RED;
+	}
+	else if (image.nrComponents == 3)
+	{
+		format = GL_RGB;
+	}
+	else if (image.nrComponents == 4)
+	{
+		format = GL_RGBA;
+	}
+
+	GLState::Shared().BindTexture(GL_TEXTURE_2D, textureID);
+	if (image.levels.empty())
+	{
+		glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, pixels);
+		glGenerateMipmap(GL_TEXTURE_2D);
+	}
+	else
+	{
+		// baked levels are tightly packed, rows of small RGB levels aren't 4 byte aligned
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		for (size_t level = 0; level < image.levels.size(); level++)
+		{
+			const TextureLevel &mip = image.levels[level];
+			const unsigned char *levelPixels = static_cast<const unsigned char*>(pixels) + mip.offset;
+			if (image.compressedFormat)
+			{
+				glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)level, image.compressedFormat, mip.width, mip.height, 0,
+					(GLsizei)mip.size, levelPixels);
+			}
+			else
+			{
+				glTexImage2D(GL_TEXTURE_2D, (GLint)level, format, mip.width, mip.height, 0, format, GL_UNSIGNED_BYTE, levelPixels);
+			}
+		}
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)image.levels.size() - 1);
+	}
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+size_t TextureImageSize(const TextureImage &image)
+{
+	if (!image.levels.empty())
+	{
+		return image.levels.back().offset + image.levels.back().size;
+	}
+	return (size_t)image.width * image.height * image.nrComponents;
+}
+
+unsigned int TextureFromFile(const char *path, const std::string &directory, bool gamma)
+{
+	return UploadTextureImage(DecodeTextureImage(path, directory), gamma);
+}
+
+TextureManager& TextureManager::Shared()
+{
+	static TextureManager manager;
+	return manager;
+}
+
+std::string TextureManager::CanonicalPath(const std::string &path, const std::string &directory)
+{
+	std::string joined = directory.empty() ? path : directory + "/" + path;
+	for (char &c : joined)
+	{
+		if (c == '\\')
+		{
+			c = '/';
+		}
+	}
+
+	bool absolute = !joined.empty() && joined[0] == '/';
+	std::vector<std::string> segments;
+	size_t start = 0;
+	while (start <= joined.size())
+	{
+		size_t end = joined.find('/', start);
+		if (end == std::string::npos)
+		{
+			end = joined.size();
+		}
+		std::string segment = joined.substr(start, end - start);
+		if (segment == "..")
+		{
+			// a leading ".." has nothing to cancel and stays
+			if (!segments.empty() && segments.back() != "..")
+			{
+				segments.pop_back();
+			}
+			else if (!absolute)
+			{
+				segments.push_back(segment);
+			}
+		}
+		else if (!segment.empty() && segment != ".")
+		{
+			segments.push_back(segment);
+		}
+		start = end + 1;
+	}
+
+	std::string canonical = absolute ? "/" : "";
+	for (size_t i = 0; i < segments.size(); i++)
+	{
+		if (i > 0)
+		{
+			canonical += '/';
+		}
+		canonical += segments[i];
+	}
+	return canonical;
+}
+
+std::string TextureManager::cacheKey(const std::string &canonicalPath, bool gamma)
+{
+	// the same file loaded as sRGB and linear are two different textures
+	return gamma ? canonicalPath + "|srgb" : canonicalPath;
+}
+
+uint64_t TextureManager::contentKey(uint64_t contentHash, bool gamma)
+{
+	// same for identical pixels, so an sRGB request can't be served by the linear texture or the other way around
+	if (contentHash == 0)
+	{
+		return 0;
+	}
+	uint64_t key = gamma ? contentHash ^ 0x9e3779b97f4a7c15ull : contentHash;
+	return key != 0 ? key : 1;
+}
+
+unsigned int TextureManager::acquireExisting(const std::string &key, uint64_t contentKey)
+{
+	auto path = byPath.find(key);
+	if (path != byPath.end())
+	{
+		entries[path->second].refCount++;
+		stats.pathHits++;
+		return path->second;
+	}
+	if (contentKey != 0)
+	{
+		auto content = byContent.find(contentKey);
+		if (content != byContent.end())
+		{
+			// remember the new path so the next request doesn't need the pixels
+			Entry &entry = entries[content->second];
+			entry.refCount++;
+			entry.keys.push_back(key);
+			byPath[key] = content->second;
+			stats.contentHits++;
+			return content->second;
+		}
+	}
+	return 0;
+}
+
+unsigned int TextureManager::addEntry(const std::string &key, uint64_t contentKey, unsigned int id)
+{
+	Entry entry;
+	entry.refCount = 1;
+	entry.contentKey = contentKey;
+	entry.keys.push_back(key);
+	entries[id] = entry;
+	byPath[key] = id;
+	if (contentKey != 0)
+	{
+		byContent[contentKey] = id;
+	}
+	stats.uploads++;
+	return id;
+}
+
+unsigned int TextureManager::Load(const std::string &path, const std::string &directory, bool gamma)
+{
+	std::string key = cacheKey(CanonicalPath(path, directory), gamma);
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stats.requests++;
+		unsigned int id = acquireExisting(key, 0);
+		if (id)
+		{
+			return id;
+		}
+	}
+
+	// decoding doesn't need the lock, only this thread uploads
+	TextureImage image = DecodeTextureImage(path.c_str(), directory.empty() ? "." : directory);
+	return addUploaded(key, image, gamma);
+}
+
+unsigned int TextureManager::Acquire(const TextureImage &image, const std::string &directory, bool gamma)
+{
+	std::string key = cacheKey(CanonicalPath(image.path, directory), gamma);
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stats.requests++;
+	}
+	return addUploaded(key, image, gamma);
+}
+
+unsigned int TextureManager::addUploaded(const std::string &key, const TextureImage &image, bool gamma)
+{
+	// the upload and mip generation run without the lock, so loader threads asking Contains or Reserve
+	// don't wait for the GL work
+	uint64_t content = contentKey(image.contentHash, gamma);
+	unsigned int id;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		id = acquireExisting(key, content);
+		if (id)
+		{
+			return id;
+		}
+	}
+	unsigned int uploaded = UploadTextureImage(image, gamma);
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		id = acquireExisting(key, content);
+		if (!id)
+		{
+			return addEntry(key, content, uploaded);
+		}
+	}
+	// someone else got there first in the meantime, keep theirs
+	GLState::Shared().ForgetTexture(uploaded);
+	glDeleteTextures(1, &uploaded);
+	return id;
+}
+
+unsigned int TextureManager::Reserve(const std::string &path, const std::string &directory, bool gamma, bool &created)
+{
+	std::string key = cacheKey(CanonicalPath(path, directory), gamma);
+	std::lock_guard<std::mutex> lock(mutex);
+	stats.requests++;
+	created = false;
+	unsigned int id = acquireExisting(key, 0);
+	if (id)
+	{
+		return id;
+	}
+	glGenTextures(1, &id);
+	created = true;
+	return addEntry(key, 0, id);
+}
+
+void TextureManager::SetContentHash(unsigned int id, uint64_t contentHash, bool gamma)
+{
+	uint64_t key = contentKey(contentHash, gamma);
+	std::lock_guard<std::mutex> lock(mutex);
+	auto found = entries.find(id);
+	// the first texture with these pixels keeps serving content lookups
+	if (found == entries.end() || key == 0 || found->second.contentKey != 0 || byContent.count(key))
+	{
+		return;
+	}
+	found->second.contentKey = key;
+	byContent[key] = id;
+}
+
+void TextureManager::AddRef(unsigned int id)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto found = entries.find(id);
+	if (found != entries.end())
+	{
+		found->second.refCount++;
+	}
+}
+
+bool TextureManager::Contains(const std::string &path, const std::string &directory, bool gamma) const
+{
+	std::string key = cacheKey(CanonicalPath(path, directory), gamma);
+	std::lock_guard<std::mutex> lock(mutex);
+	return byPath.find(key) != byPath.end();
+}
+
+void TextureManager::Release(unsigned int id)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto found = entries.find(id);
+	if (found == entries.end())
+	{
+		std::cout << "ERROR::TEXTURE_MANAGER::RELEASE_OF_UNKNOWN_TEXTURE " << id << std::endl;
+		return;
+	}
+	if (--found->second.refCount > 0)
+	{
+		return;
+	}
+
+	for (const std::string &key : found->second.keys)
+	{
+		byPath.erase(key);
+	}
+	if (found->second.contentKey != 0)
+	{
+		byContent.erase(found->second.contentKey);
+	}
+	entries.erase(found);
+	GLState::Shared().ForgetTexture(id);
+	glDeleteTextures(1, &id);
+	stats.deletes++;
+}
+
+TextureManager::Stats TextureManager::GetStats() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	Stats current = stats;
+	current.resident = (unsigned int)entries.size();
+	return current;
+}
+
+void TextureManager::PrintStats() const
+{
+	Stats current = GetStats();
+	unsigned int hits = current.pathHits + current.contentHits;
+	std::cout << "TEXTURE_MANAGER::" << current.requests << " requests, " << current.uploads << " uploads, "
+		<< hits << " hits (" << current.contentHits << " by content), hit rate "
+		<< (current.requests ? 100.0f * hits / current.requests : 0.0f) << "%, "
+		<< current.resident << " resident" << std::endl;
+}
@@ -0,0 +1,112 @@
+#pragma once
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// one precomputed mip level, offset is from the start of TextureImage::data
+struct TextureLevel {
+	int width;
+	int height;
+	size_t offset;
+	size_t size;
+};
+
+// texture pixels decoded on the CPU, waiting to be uploaded
+struct TextureImage {
+	std::string path;
+	int width = 0;
+	int height = 0;
+	int nrComponents = 0;
+	std::shared_ptr<unsigned char> data;
+	// hash of the size and pixels, 0 when nothing was decoded
+	uint64_t contentHash = 0;
+	// the whole mip chain when loaded from a baked texture, empty when mipmaps are generated on upload
+	std::vector<TextureLevel> levels;
+	// internal format of the levels when they're block compressed, 0 for plain pixels
+	GLenum compressedFormat = 0;
+};
+
+// uses the baked texture (see BakedTexture.h) when there is an up to date one
+
+TextureImage DecodeTextureImage(const char *path, const std::string &directory);
+unsigned int UploadTextureImage(const TextureImage &image, bool gamma = false);
+// same, into an existing texture name
+void UploadTextureImage(unsigned int textureID, const TextureImage &image, bool gamma = false);
+// uploads pixels laid out like image's, which can also be an offset into the bound GL_PIXEL_UNPACK_BUFFER
+void UploadTextureImage(unsigned int textureID, const TextureImage &image, const void *pixels, bool gamma = false);
+// tightly packed size of the decoded pixels, all levels included
+size_t TextureImageSize(const TextureImage &image);
+uint64_t TextureImageHash(const unsigned char *pixels, int width, int height, int nrComponents);
+unsigned int TextureFromFile(const char *path, const std::string &directory, bool gamma = false);
+
+// Process wide owner of every 2D texture loaded from a file. Textures are looked up by canonical path
+// first and by content second, so the same file reached through different paths, or identical copies
+// of it, end up as one GL texture. Every Load/Acquire takes a reference that Release gives back, the
+// texture is deleted with the last one. Lookups are thread safe, GL work happens on the calling thread.
+class TextureManager
+{
+public:
+	/* Functions */
+	static TextureManager& Shared();
+
+	// directory + "/" + path with '\' turned into '/' and "." and ".." segments resolved
+	static std::string CanonicalPath(const std::string &path, const std::string &directory = "");
+
+	// returns the texture for the file, decoding and uploading it on a miss. call on the GL thread
+	unsigned int Load(const std::string &path, const std::string &directory = "", bool gamma = false);
+	// same for an image decoded elsewhere, the pixels are only uploaded if nobody has them yet
+	unsigned int Acquire(const TextureImage &image, const std::string &directory, bool gamma = false);
+	// the texture for the file if there is one, otherwise a new texture name without contents that the
+	// caller fills (created is set then). content sharing only applies once SetContentHash is called
+	unsigned int Reserve(const std::string &path, const std::string &directory, bool gamma, bool &created);
+	void SetContentHash(unsigned int id, uint64_t contentHash, bool gamma);
+	// true when the file is resident already, lets importers skip decoding it. any thread
+	bool Contains(const std::string &path, const std::string &directory = "", bool gamma = false) const;
+	// takes another reference on a texture handed out before
+	void AddRef(unsigned int id);
+	// gives back one reference, call on the GL thread
+	void Release(unsigned int id);
+
+	struct Stats {
+		unsigned int requests;
+		unsigned int pathHits;		// found by path
+		unsigned int contentHits;	// new path, but the pixels were resident already
+		unsigned int uploads;
+		unsigned int deletes;
+		unsigned int resident;
+	};
+	Stats GetStats() const;
+	void PrintStats() const;
+
+private:
+	TextureManager() = default;
+	TextureManager(const TextureManager&) = delete;
+	TextureManager& operator=(const TextureManager&) = delete;
+
+	/* Cache Data */
+	struct Entry {
+		unsigned int refCount;
+		uint64_t contentKey;	// contentKey() of the pixels and gamma, 0 when unknown
+		std::vector<std::string> keys;	// every path it has been requested by
+	};
+	mutable std::mutex mutex;
+	std::unordered_map<std::string, unsigned int> byPath;
+	std::unordered_map<uint64_t, unsigned int> byContent;	// by contentKey()
+	std::unordered_map<unsigned int, Entry> entries;
+	Stats stats = Stats();
+
+	/* Functions */
+	static std::string cacheKey(const std::string &canonicalPath, bool gamma);
+	static uint64_t contentKey(uint64_t contentHash, bool gamma);
+	// takes a reference on an existing texture, 0 if there is none. expects the mutex to be held
+	unsigned int acquireExisting(const std::string &key, uint64_t contentKey);
+	unsigned int addEntry(const std::string &key, uint64_t contentKey, unsigned int id);
+	// the existing texture for the key or pixels, otherwise uploads image without holding the mutex and adds
+	// it, unless another thread added one in the meantime
+	unsigned int addUploaded(const std::string &key, const TextureImage &image, bool gamma);
+};
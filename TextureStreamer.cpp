@@ -0,0 +1,153 @@
+#include "TextureStreamer.h"
+#include "GLState.h"
+#include "ThreadPool.h"
+
+#include <iostream>
+#include <thread>
+
+TextureStreamer& TextureStreamer::Shared()
+{
+	static TextureStreamer streamer;
+	return streamer;
+}
+
+unsigned int TextureStreamer::Request(const std::string &path, const std::string &directory, bool gamma)
+{
+	TextureManager &manager = TextureManager::Shared();
+	bool created;
+	unsigned int id = manager.Reserve(path, directory, gamma, created);
+	if (!created)
+	{
+		// resident already, or requested before and still on its way
+		return id;
+	}
+
+	// 1x1 grey until the real pixels arrive, so the texture is complete for sampling
+	const unsigned char grey[4] = { 128, 128, 128, 255 };
+	GLState::Shared().BindTexture(GL_TEXTURE_2D, id);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	// the streamer holds its own reference while the decode is in flight, so a Release by the
+	// requester in the meantime can't delete the name the upload is going to fill
+	manager.AddRef(id);
+	if (pending.fetch_add(1) == 0)
+	{
+		burstStart = Clock::now();
+		burstTextures = 0;
+		burstDecodeMilliseconds = 0.0;
+		burstUploadMilliseconds = 0.0;
+		burstClientUploads = 0;
+	}
+	if (!ring)
+	{
+		ring.reset(new PixelUploadRing());
+	}
+
+	// one job per image, so a model's textures decode on all workers at once
+	std::string decodeDirectory = directory.empty() ? "." : directory;
+	PixelUploadRing *stagingRing = ring.get();
+	ThreadPool::Shared().Submit([this, stagingRing, id, gamma, path, decodeDirectory]() {
+		Clock::time_point start = Clock::now();
+		DecodedTexture texture;
+		texture.id = id;
+		texture.gamma = gamma;
+		texture.image = DecodeTextureImage(path.c_str(), decodeDirectory);
+		texture.staged = false;
+		// copy straight into mapped buffer memory when there's room, otherwise the GL thread stages it
+		size_t size = TextureImageSize(texture.image);
+		if (texture.image.data && stagingRing->Persistent() && stagingRing->Allocate(size, texture.region))
+		{
+			stagingRing->Write(texture.region, texture.image.data.get(), size);
+			texture.image.data.reset();
+			texture.staged = true;
+		}
+		texture.decodeMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+		decoded.Push(std::move(texture));
+	});
+	return id;
+}
+
+unsigned int TextureStreamer::Update(double budgetMilliseconds)
+{
+	Clock::time_point start = Clock::now();
+	if (ring)
+	{
+		ring->Retire();
+	}
+	unsigned int uploaded = 0;
+	DecodedTexture texture;
+	while (decoded.Pop(texture))
+	{
+		upload(texture);
+		uploaded++;
+		if (std::chrono::duration<double, std::milli>(Clock::now() - start).count() >= budgetMilliseconds)
+		{
+			break;
+		}
+	}
+	return uploaded;
+}
+
+void TextureStreamer::Finish()
+{
+	while (pending.load() > 0)
+	{
+		if (Update(1000.0) == 0)
+		{
+			std::this_thread::yield();
+		}
+	}
+}
+
+void TextureStreamer::upload(DecodedTexture &texture)
+{
+	Clock::time_point start = Clock::now();
+	TextureManager &manager = TextureManager::Shared();
+	size_t size = TextureImageSize(texture.image);
+	if (!texture.staged && texture.image.data && ring->Allocate(size, texture.region))
+	{
+		ring->Write(texture.region, texture.image.data.get(), size);
+		texture.staged = true;
+	}
+	if (texture.staged)
+	{
+		// the source is an offset into the bound unpack buffer, the copy runs asynchronously
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring->Buffer());
+		UploadTextureImage(texture.id, texture.image, reinterpret_cast<const void*>(texture.region.offset), texture.gamma);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		ring->Submit(texture.region);
+	}
+	else
+	{
+		// bigger than the ring or nothing decoded
+		UploadTextureImage(texture.id, texture.image, texture.gamma);
+		if (texture.image.data)
+		{
+			burstClientUploads++;
+		}
+	}
+	manager.SetContentHash(texture.id, texture.image.contentHash, texture.gamma);
+	manager.Release(texture.id);
+
+	burstTextures++;
+	burstDecodeMilliseconds += texture.decodeMilliseconds;
+	burstUploadMilliseconds += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	if (pending.fetch_sub(1) == 1)
+	{
+		double total = std::chrono::duration<double, std::milli>(Clock::now() - burstStart).count();
+		std::cout << "TEXTURE_STREAMER::" << burstTextures << " textures in " << total << " ms (decode "
+			<< burstDecodeMilliseconds << " ms across workers, upload " << burstUploadMilliseconds << " ms, "
+			<< burstClientUploads << " from client memory)" << std::endl;
+	}
+}
+
+void TextureStreamer::Release()
+{
+	if (ring)
+	{
+		ring->Release();
+		ring.reset();
+	}
+}
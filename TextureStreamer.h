@@ -0,0 +1,66 @@
+#pragma once
+#include <glad/glad.h>
+
+#include "TextureManager.h"
+#include "MpscQueue.h"
+#include "PixelUploadRing.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+
+// Loads textures without stalling the GL thread. Request() hands out the final texture name right away
+// (showing a grey placeholder), the file is read and decoded by a job on the thread pool, and the
+// decoded image goes through a lock-free queue back to the GL thread, where Update() uploads as many
+// images as fit in its time budget. Textures already in the TextureManager are returned directly.
+// Uploads are staged in a PixelUploadRing, with a persistently mapped ring the decode jobs copy the
+// pixels into it themselves and the GL thread only issues the copy from the buffer.
+class TextureStreamer
+{
+public:
+	/* Functions */
+	static TextureStreamer& Shared();
+
+	// takes a TextureManager reference like TextureManager::Load. call on the GL thread
+	unsigned int Request(const std::string &path, const std::string &directory = "", bool gamma = false);
+	// uploads decoded images until budgetMilliseconds are used up (at least one per call), returns how many
+	unsigned int Update(double budgetMilliseconds);
+	// waits for every requested texture and uploads it
+	void Finish();
+	unsigned int Pending() const { return pending.load(); }
+
+	// delete the GL objects, call after Finish() and before the context goes away
+	void Release();
+
+private:
+	TextureStreamer() = default;
+	TextureStreamer(const TextureStreamer&) = delete;
+	TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+	/* Streaming Data */
+	struct DecodedTexture {
+		unsigned int id;
+		bool gamma;
+		TextureImage image;
+		double decodeMilliseconds;
+		// the pixels are in the ring already, image.data has been freed then
+		bool staged;
+		PixelUploadRing::Region region;
+	};
+	MpscQueue<DecodedTexture> decoded;
+	std::atomic<unsigned int> pending{ 0 };
+	// created with the first request, which runs on the GL thread
+	std::unique_ptr<PixelUploadRing> ring;
+
+	// timings of the current burst of requests, printed once it's done
+	typedef std::chrono::high_resolution_clock Clock;
+	Clock::time_point burstStart;
+	unsigned int burstTextures = 0;
+	double burstDecodeMilliseconds = 0.0;
+	double burstUploadMilliseconds = 0.0;
+	unsigned int burstClientUploads = 0;
+
+	/* Functions */
+	void upload(DecodedTexture &texture);
+};
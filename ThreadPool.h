@@ -0,0 +1,56 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed size pool of worker threads running jobs in submission order.
+class ThreadPool
+{
+public:
+	/* Functions */
+	// threadCount 0 picks one worker per hardware thread, minus the render thread
+	explicit ThreadPool(unsigned int threadCount = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// process wide pool used for asset loading
+	static ThreadPool& Shared();
+
+	// queue a job, the returned future holds its result (or the exception it threw)
+	template<typename F>
+	auto Submit(F &&job) -> std::future<decltype(job())>
+	{
+		typedef decltype(job()) Result;
+		auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(job));
+		std::future<Result> result = task->get_future();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			jobs.push_back([task]() { (*task)(); });
+		}
+		wakeUp.notify_one();
+		return result;
+	}
+
+	unsigned int ThreadCount() const { return (unsigned int)workers.size(); }
+	// true on the pool's own threads, where waiting for other jobs of the pool can deadlock
+	bool IsWorkerThread() const;
+
+private:
+	/* Pool Data */
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()>> jobs;
+	std::mutex mutex;
+	std::condition_variable wakeUp;
+	bool stopping;
+
+	/* Functions */
+	void workerLoop();
+};
@@ -0,0 +1,197 @@
+#include "Vertex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+
+// half floats keep about 3 decimal digits, beyond this the texture coordinates start to swim
+static const float MAX_PACKED_TEXCOORD = 64.0f;
+
+static int16_t toSnorm16(float value)
+{
+	value = std::min(std::max(value, -1.0f), 1.0f);
+	return (int16_t)std::lround(value * 32767.0f);
+}
+
+static void octEncode(const glm::vec3 &vector, int16_t encoded[2])
+{
+	// project onto the octahedron, then fold the lower hemisphere over the upper one
+	float length = std::fabs(vector.x) + std::fabs(vector.y) + std::fabs(vector.z);
+	if (length == 0.0f)
+	{
+		encoded[0] = 0;
+		encoded[1] = 0;
+		return;
+	}
+
+	float x = vector.x / length;
+	float y = vector.y / length;
+	if (vector.z < 0.0f)
+	{
+		float foldedX = (1.0f - std::fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		float foldedY = (1.0f - std::fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		x = foldedX;
+		y = foldedY;
+	}
+	encoded[0] = toSnorm16(x);
+	encoded[1] = toSnorm16(y);
+}
+
+uint16_t FloatToHalf(float value)
+{
+	uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+
+	uint32_t sign = (bits >> 16) & 0x8000u;
+	int32_t exponent = (int32_t)((bits >> 23) & 0xffu) - 127 + 15;
+	uint32_t mantissa = bits & 0x7fffffu;
+
+	if (((bits >> 23) & 0xffu) == 0xffu)
+	{
+		// infinity or NaN
+		return (uint16_t)(sign | 0x7c00u | (mantissa ? 0x200u : 0u));
+	}
+	if (exponent >= 31)
+	{
+		return (uint16_t)(sign | 0x7c00u);
+	}
+	if (exponent <= 0)
+	{
+		// denormal or zero
+		if (exponent < -10)
+		{
+			return (uint16_t)sign;
+		}
+		mantissa |= 0x800000u;
+		uint32_t shift = (uint32_t)(14 - exponent);
+		uint32_t half = mantissa >> shift;
+		// round to nearest even
+		uint32_t remainder = mantissa & ((1u << shift) - 1u);
+		uint32_t halfway = 1u << (shift - 1u);
+		if (remainder > halfway || (remainder == halfway && (half & 1u)))
+		{
+			half++;
+		}
+		return (uint16_t)(sign | half);
+	}
+
+	uint32_t half = sign | ((uint32_t)exponent << 10) | (mantissa >> 13);
+	uint32_t remainder = mantissa & 0x1fffu;
+	if (remainder > 0x1000u || (remainder == 0x1000u && (half & 1u)))
+	{
+		half++; // may carry into the exponent, which is still correct
+	}
+	return (uint16_t)half;
+}
+
+bool CanPackVertices(const std::vector<Vertex> &vertices)
+{
+	for (const Vertex &vertex : vertices)
+	{
+		if (!(std::fabs(vertex.TexCoords.x) <= MAX_PACKED_TEXCOORD && std::fabs(vertex.TexCoords.y) <= MAX_PACKED_TEXCOORD))
+		{
+			return false;
+		}
+	}
+	return !vertices.empty();
+}
+
+VertexQuantization PackVertices(const std::vector<Vertex> &vertices, std::vector<PackedVertex> &packed)
+{
+	glm::vec3 minimum = vertices[0].Position;
+	glm::vec3 maximum = vertices[0].Position;
+	for (const Vertex &vertex : vertices)
+	{
+		minimum = glm::min(minimum, vertex.Position);
+		maximum = glm::max(maximum, vertex.Position);
+	}
+
+	VertexQuantization quantization;
+	quantization.positionOffset = (minimum + maximum) * 0.5f;
+	quantization.positionScale = (maximum - minimum) * 0.5f;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		if (quantization.positionScale[axis] <= 0.0f)
+		{
+			quantization.positionScale[axis] = 1.0f; // flat along this axis
+		}
+	}
+
+	packed.resize(vertices.size());
+	for (size_t i = 0; i < vertices.size(); i++)
+	{
+		const Vertex &vertex = vertices[i];
+		PackedVertex &out = packed[i];
+
+		glm::vec3 position = (vertex.Position - quantization.positionOffset) / quantization.positionScale;
+		out.Position[0] = toSnorm16(position.x);
+		out.Position[1] = toSnorm16(position.y);
+		out.Position[2] = toSnorm16(position.z);
+
+		// handedness of the tangent frame, so the bitangent can be rebuilt in the shader
+		float handedness = glm::dot(glm::cross(vertex.Normal, vertex.Tangent), vertex.Bitangent);
+		out.Position[3] = handedness < 0.0f ? -32767 : 32767;
+
+		octEncode(vertex.Normal, out.Normal);
+		octEncode(vertex.Tangent, out.Tangent);
+
+		out.TexCoords[0] = FloatToHalf(vertex.TexCoords.x);
+		out.TexCoords[1] = FloatToHalf(vertex.TexCoords.y);
+	}
+	return quantization;
+}
+
+static void setupFullAttributes()
+{
+	// vertex positions
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+
+	// vertex normals
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+
+	// vertex texture coords
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+
+	// vertex tangent
+	glEnableVertexAttribArray(3);
+	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
+
+	// vertex bitantent
+	glEnableVertexAttribArray(4);
+	glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+}
+
+static void setupPackedAttributes()
+{
+	// vertex positions (snorm16, w is the bitangent sign)
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 4, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Position));
+
+	// vertex normals (octahedral snorm16)
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Normal));
+
+	// vertex texture coords (half float)
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, TexCoords));
+
+	// vertex tangent (octahedral snorm16), the bitangent is derived in the shader
+	glEnableVertexAttribArray(3);
+	glVertexAttribPointer(3, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Tangent));
+}
+
+void SetupVertexAttributes(VertexFormat format)
+{
+	if (format == VERTEX_FORMAT_PACKED)
+	{
+		setupPackedAttributes();
+	}
+	else
+	{
+		setupFullAttributes();
+	}
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+struct Vertex {
+	// position
+	glm::vec3 Position;
+	// normal
+	glm::vec3 Normal;
+	// texture coordinates
+	glm::vec2 TexCoords;
+	// tangent
+	glm::vec3 Tangent;
+	// bitangent
+	glm::vec3 Bitangent;
+};
+
+// vertex layout a mesh is uploaded with
+enum VertexFormat {
+	VERTEX_FORMAT_FULL,		// Vertex, 56 bytes of floats
+	VERTEX_FORMAT_PACKED	// PackedVertex, 20 bytes
+};
+
+// Quantized vertex, decoded by the vertex shaders when packedVertex is set:
+// - Position is snorm16 relative to the mesh bounds (see VertexQuantization), w holds the bitangent sign
+// - Normal and Tangent are octahedral encoded snorm16 pairs, the bitangent is cross(Normal, Tangent) * sign
+// - TexCoords are half floats
+struct PackedVertex {
+	int16_t Position[4];
+	int16_t Normal[2];
+	int16_t Tangent[2];
+	uint16_t TexCoords[2];
+};
+
+static_assert(sizeof(PackedVertex) == 20, "PackedVertex must stay tightly packed");
+
+// maps snorm16 positions back to object space: position = offset + packed * scale
+struct VertexQuantization {
+	glm::vec3 positionOffset;
+	glm::vec3 positionScale;
+};
+
+// false when the mesh can't be packed without visible error (e.g. texture coordinates far outside [0, 1])
+bool CanPackVertices(const std::vector<Vertex> &vertices);
+VertexQuantization PackVertices(const std::vector<Vertex> &vertices, std::vector<PackedVertex> &packed);
+
+uint16_t FloatToHalf(float value);
+
+// enables and points the vertex attributes of the bound VAO at the bound array buffer
+void SetupVertexAttributes(VertexFormat format);
@@ -9,14 +9,40 @@ out vec3 Normal;
 out vec2 TexCoords;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+
+// set while a model is drawn instanced, the model matrix then comes from the instance attributes
+uniform bool instanced;
+layout (location = 5) in mat4 aInstanceModel;
+
+// packed meshes store snorm16 positions relative to their bounds and octahedral encoded normals
+uniform bool packedVertex;
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
+layout (std140) uniform Camera
+{
+	mat4 view;
+	mat4 projection;
+	vec4 viewPos;
+};
+
+vec3 octDecode(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0.0)
+		n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	return normalize(n);
+}
 
 void main()
 {
-	FragPos = vec3(model * vec4(aPos, 1.0));
-	Normal = mat3(transpose(inverse(model))) * aNormal;
+	mat4 world = instanced ? aInstanceModel : model;
+	vec3 position = packedVertex ? positionOffset + aPos * positionScale : aPos;
+	vec3 normal = packedVertex ? octDecode(aNormal.xy) : aNormal;
+
+	FragPos = vec3(world * vec4(position, 1.0));
+	Normal = mat3(transpose(inverse(world))) * normal;
 
     TexCoords = aTexCoords;    
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    gl_Position = projection * view * world * vec4(position, 1.0);
 }
\ No newline at end of file